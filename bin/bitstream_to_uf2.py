@@ -10,6 +10,7 @@ import sys
 import os.path
 import argparse
 import struct
+import zlib
 UF2UtilsPresent = True
 try:
     from uf2utils.file import UF2File
@@ -77,6 +78,13 @@ metadata_payload_header = "RFMETA"
 metadata_payload_version = "01"
 metadata_proj_name_maxlen = 23
 
+metadata_flag_compressed_rle = 0x01
+metadata_flag_volatile = 0x02
+metadata_flag_crc32 = 0x04
+
+uf2_payload_size_default = 256
+uf2_payload_size_max = 476 # all the data a 512 byte UF2 block has room for
+
 factoryreset_start1_offset = 0xdead
 factoryreset_payload_header = "RFRSET"
 
@@ -110,6 +118,18 @@ def get_args():
                         help='Auto-clock preference for project, in Hz [10-40M]')
                         
         
+    parser.add_argument('--compress', required=False,
+                        action='store_true',
+                        help='RLE compress bitstream (smaller upload, decompressed while programming)')
+
+    parser.add_argument('--payload-size', required=False, type=int,
+                        default=uf2_payload_size_default,
+                        help=f'Bitstream bytes per UF2 block, up to {uf2_payload_size_max} for fewer blocks to copy [{uf2_payload_size_default}]')
+
+    parser.add_argument('--volatile', required=False,
+                        action='store_true',
+                        help='Load straight into the FPGA from RAM, leaving flash slots untouched')
+
     parser.add_argument('--appendslot', required=False,
                         action='store_true',
                         help='Append to slot to output file name')
@@ -133,6 +153,68 @@ def get_payload_contents(infilepath:str):
     
     return bts
 
+# RLE codec, must match src/bs_rle.h
+#  0x00-0x7F  (ctrl + 1) literal bytes follow
+#  0x80-0xFE  next byte is repeated (ctrl - 0x80 + 3) times
+#  0xFF       uint16 LE count, then byte to repeat count times
+rle_literal_max = 0x80
+rle_run_min = 3
+rle_run_short_max = 0xFE - 0x80 + rle_run_min
+rle_run_long_max = 0xFFFF
+
+def rle_compress(data:bytes):
+    out = bytearray()
+    literals = bytearray()
+    
+    def flush_literals():
+        while len(literals):
+            chunk = literals[:rle_literal_max]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+            del literals[:rle_literal_max]
+    
+    i = 0
+    datalen = len(data)
+    while i < datalen:
+        runlen = 1
+        while (i + runlen) < datalen and data[i + runlen] == data[i] and runlen < rle_run_long_max:
+            runlen += 1
+        
+        if runlen < rle_run_min:
+            literals.extend(data[i:i + runlen])
+            i += runlen
+            continue 
+        
+        flush_literals()
+        if runlen <= rle_run_short_max:
+            out.append(0x80 + runlen - rle_run_min)
+            out.append(data[i])
+        else:
+            out.append(0xFF)
+            out.extend(struct.pack('<HB', runlen, data[i]))
+        i += runlen
+        
+    flush_literals()
+    return bytes(out)
+
+def rle_decompress(data:bytes):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        ctrl = data[i]
+        i += 1
+        if ctrl < 0x80:
+            out.extend(data[i:i + ctrl + 1])
+            i += ctrl + 1
+        elif ctrl < 0xFF:
+            out.extend(bytes([data[i]]) * (ctrl - 0x80 + rle_run_min))
+            i += 1
+        else:
+            (count, val) = struct.unpack('<HB', data[i:i+3])
+            out.extend(bytes([val]) * count)
+            i += 3
+    return bytes(out)
+
 def get_new_uf2(settings:UF2Settings):
     
     myBoard = Family(id=settings.boardFamily, name=settings.name, description=settings.description)
@@ -146,7 +228,7 @@ def get_new_uf2(settings:UF2Settings):
 
 
 def get_metadata_block(settings:UF2Settings, flash_address:int, bitstreamSize:int, autoclock:int, 
-    filename:str, bitstreamName:str=None):
+    filename:str, bitstreamName:str=None, flags:int=0, crc32:int=0):
     if bitstreamName is None or not len(bitstreamName):
         extsplit = os.path.splitext(filename)
         if extsplit and len(extsplit) > 1:
@@ -172,10 +254,12 @@ def get_metadata_block(settings:UF2Settings, flash_address:int, bitstreamSize:in
     #  uint8  namelen
     #  char name[metadata_proj_name_maxlen]
     #  uint32 clock_hz
+    #  uint8  flags
+    #  uint32 crc32
     
     payload = bytes(metaheader, encoding='ascii')
     payload += struct.pack('<IB', bitstreamSize, bsnamelen) + bsnameArray
-    payload += struct.pack('<I', autoclock)
+    payload += struct.pack('<IBI', autoclock, flags | metadata_flag_crc32, crc32)
     # print(payload)
     hdr = Header(Flags.FamilyIDPresent | Flags.NotMainFlash, flash_address, len(payload), 0, 1, settings.boardFamily)
     return DataBlock(payload, hdr, magic_start1=(settings.magicStart1+metadata_start1_offset),
@@ -225,6 +309,10 @@ def main():
     if len(args.name) > metadata_proj_name_maxlen:
         print(f'Name can only be up to {metadata_proj_name_maxlen} characters. Will truncate.')
         
+    if args.payload_size < 1 or args.payload_size > uf2_payload_size_max:
+        print(f"Payload size must be between 1 and {uf2_payload_size_max}")
+        sys.exit(-6)
+        
     if args.autoclock:
         if args.autoclock < 10 or args.autoclock > 60e6:
             print("Auto-clocking only supports rates between 10Hz and 60MHz")
@@ -233,6 +321,23 @@ def main():
     
     slotidx = args.slot - 1
     payload_bytes = get_payload_contents(args.infile)
+    bitstream_size = len(payload_bytes)
+    # of the stream as clocked in, checked by the device while programming
+    bitstream_crc32 = zlib.crc32(payload_bytes)
+    meta_flags = 0
+    if args.volatile:
+        if args.compress:
+            print("ERROR: volatile bitstreams are loaded from RAM and can't be compressed")
+            sys.exit(-5)
+        meta_flags |= metadata_flag_volatile
+    if args.compress:
+        compressed = rle_compress(payload_bytes)
+        if rle_decompress(compressed) != payload_bytes:
+            print("ERROR: compression round-trip failed, not generating UF2")
+            sys.exit(-4)
+        print(f"Compressed {bitstream_size} bytes to {len(compressed)} ({100.0*len(compressed)/bitstream_size:.1f}%)")
+        payload_bytes = compressed
+        meta_flags |= metadata_flag_compressed_rle
     
     # stick it somewhere within its slot...
     
@@ -258,11 +363,11 @@ def main():
     
     # append a data block for meta information
     uf2.append_datablock(get_metadata_block(uf2sets, start_offset, 
-                        len(payload_bytes), args.autoclock, 
-                        args.infile, args.name))
+                        bitstream_size, args.autoclock, 
+                        args.infile, args.name, meta_flags, bitstream_crc32))
     uf2.append_payload(payload_bytes, 
                        start_offset=start_offset, 
-                       block_payload_size=256)
+                       block_payload_size=args.payload_size)
                        
     if args.appendslot:
         fnameext = os.path.splitext(args.outfile)
@@ -271,7 +376,10 @@ def main():
         outfilename = args.outfile
     
     uf2.to_file(outfilename)
-    print(f"\n\nGenerated UF2 for slot {args.slot}, starting at address {hex(start_offset)} with size {len(payload_bytes)}")
+    if args.volatile:
+        print(f"\n\nGenerated volatile UF2 (FPGA only, flash untouched) with size {len(payload_bytes)}")
+    else:
+        print(f"\n\nGenerated UF2 for slot {args.slot}, starting at address {hex(start_offset)} with size {len(payload_bytes)}")
     print(f"It now available at {outfilename}\n")
     
 
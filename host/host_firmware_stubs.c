@@ -0,0 +1,118 @@
+/*
+ * host_firmware_stubs.c, part of the riffpga project
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Pat Deegan
+ *    Copyright (C) 2026 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Stand-ins for the firmware modules that drive hardware (FPGA
+ * SPI, PWM clocks, the core 1 programming worker) and aren't part
+ * of the host build.  There is no FPGA: streams are swallowed, with
+ * the CRC32 still computed, and programming "succeeds" at once.
+ */
+
+#include "board.h"
+#include "bs_cache.h"
+#include "clock_pwm.h"
+#include "driver_state.h"
+#include "fpga.h"
+#include "prog_worker.h"
+
+DriverState MainDriverState;
+
+static bool fpga_crc32 = false;
+static bool fpga_programmed = false;
+
+void fpga_enter_programming_mode(void) {
+}
+
+void fpga_exit_programming_mode(void) {
+}
+
+void fpga_reset(bool set_to) {
+	(void) set_to;
+}
+
+void fpga_set_programmed(bool set_to) {
+	fpga_programmed = set_to;
+}
+
+bool fpga_is_programmed(void) {
+	return fpga_programmed;
+}
+
+void fpga_spi_write_start(const uint8_t *bts, size_t len) {
+	if (fpga_crc32) {
+		board_crc32_update(bts, len);
+	}
+}
+
+void fpga_spi_write_wait(void) {
+}
+
+void fpga_spi_drain(void) {
+}
+
+void fpga_spi_crc32_start(void) {
+	board_crc32_start();
+	fpga_crc32 = true;
+}
+
+uint32_t fpga_spi_crc32_end(void) {
+	fpga_crc32 = false;
+	uint32_t crc = board_crc32_sniff_result();
+	board_crc32_sniff_stop();
+	return crc;
+}
+
+bool clock_pwm_enable(FPGA_PWM *pwmconf) {
+	(void) pwmconf;
+	return true;
+}
+
+void clock_pwm_disable(FPGA_PWM *pwmconf) {
+	(void) pwmconf;
+}
+
+bool clock_pwm_set_freq(uint32_t freq_hz, FPGA_PWM *pwmconf) {
+	(void) freq_hz;
+	(void) pwmconf;
+	return true;
+}
+
+float clock_pwm_freq_achieved(FPGA_PWM *pwmconf) {
+	(void) pwmconf;
+	return 0;
+}
+
+bool prog_worker_busy(void) {
+	return false;
+}
+
+void prog_worker_request_abort(void) {
+}
+
+bool prog_worker_request_program_ram(const uint8_t *src, uint32_t len,
+		const Bitstream_MetaInfo *info, ProgWorkerOrigin origin) {
+	(void) src;
+	(void) len;
+	(void) info;
+	(void) origin;
+	// "clocked in" already, hand the arena back as the worker would
+	bs_cache_release();
+	return true;
+}
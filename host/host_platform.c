@@ -0,0 +1,407 @@
+/*
+ * host_platform.c, part of the riffpga project
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Pat Deegan
+ *    Copyright (C) 2026 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "host_platform.h"
+
+typedef struct hostflashstruct {
+	int fd;
+	uint8_t *mem;
+	HostFlashCounters counters;
+} HostFlash;
+
+static HostFlash host_flash = { .fd = -1 };
+
+static bool host_reboot = false;
+static bool cdc_echo = false;
+
+static void host_fatal(const char *what, uint32_t offs, size_t count) {
+	fprintf(stderr, "host flash: %s @0x%x (%zu bytes)\n", what, offs, count);
+	abort();
+}
+
+bool host_flash_open(const char *path) {
+	struct stat st;
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	if (fstat(fd, &st) != 0 || ftruncate(fd, HOST_FLASH_SIZE) != 0) {
+		fprintf(stderr, "Can't size %s: %s\n", path, strerror(errno));
+		close(fd);
+		return false;
+	}
+	void *mem = mmap((void*) XIP_BASE, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+	if (mem == MAP_FAILED || mem != (void*) XIP_BASE) {
+		fprintf(stderr, "Can't map flash image at 0x%x: %s\n", XIP_BASE,
+				strerror(errno));
+		close(fd);
+		return false;
+	}
+	if (st.st_size < HOST_FLASH_SIZE) {
+		// new (or short) image: the tail reads as erased flash
+		memset((uint8_t*) mem + st.st_size, 0xff, HOST_FLASH_SIZE - st.st_size);
+	}
+	host_flash.fd = fd;
+	host_flash.mem = (uint8_t*) mem;
+	return true;
+}
+
+void host_flash_close(void) {
+	if (host_flash.mem) {
+		msync(host_flash.mem, HOST_FLASH_SIZE, MS_SYNC);
+		munmap(host_flash.mem, HOST_FLASH_SIZE);
+		close(host_flash.fd);
+	}
+	host_flash.mem = NULL;
+	host_flash.fd = -1;
+}
+
+HostFlashCounters* host_flash_counters(void) {
+	return &host_flash.counters;
+}
+
+static uint64_t host_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+	if ((flash_offs % FLASH_SECTOR_SIZE) || (count % FLASH_SECTOR_SIZE)
+			|| (flash_offs + count) > HOST_FLASH_SIZE) {
+		host_fatal("bad erase", flash_offs, count);
+	}
+	uint64_t tstart = host_ns();
+	memset(&host_flash.mem[flash_offs], 0xff, count);
+	// same split as the boot ROM: 64k blocks where it can
+	while (count) {
+		if (!(flash_offs % FLASH_BLOCK_SIZE) && count >= FLASH_BLOCK_SIZE) {
+			host_flash.counters.block_erases++;
+			host_flash.counters.modelled_us += HOST_FLASH_BLOCK_ERASE_US;
+			flash_offs += FLASH_BLOCK_SIZE;
+			count -= FLASH_BLOCK_SIZE;
+		} else {
+			host_flash.counters.sector_erases++;
+			host_flash.counters.modelled_us += HOST_FLASH_SECTOR_ERASE_US;
+			flash_offs += FLASH_SECTOR_SIZE;
+			count -= FLASH_SECTOR_SIZE;
+		}
+	}
+	host_flash.counters.emulation_ns += host_ns() - tstart;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+	if ((flash_offs % FLASH_PAGE_SIZE) || (count % FLASH_PAGE_SIZE)
+			|| (flash_offs + count) > HOST_FLASH_SIZE) {
+		host_fatal("bad program", flash_offs, count);
+	}
+	uint64_t tstart = host_ns();
+	for (size_t i = 0; i < count; i++) {
+		host_flash.mem[flash_offs + i] &= data[i];
+	}
+	host_flash.counters.page_programs += count / FLASH_PAGE_SIZE;
+	host_flash.counters.modelled_us += (count / FLASH_PAGE_SIZE)
+			* HOST_FLASH_PAGE_PROGRAM_US;
+	host_flash.counters.emulation_ns += host_ns() - tstart;
+}
+
+int flash_safe_execute(void (*func)(void*), void *param,
+		uint32_t enter_exit_timeout_ms) {
+	(void) enter_exit_timeout_ms;
+	host_flash.counters.safe_executes++;
+	func(param);
+	return PICO_OK;
+}
+
+bool flash_safe_execute_core_init(void) {
+	return true;
+}
+
+uint64_t time_us_64(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+uint32_t time_us_32(void) {
+	return (uint32_t) time_us_64();
+}
+
+uint32_t board_millis(void) {
+	return (uint32_t) (time_us_64() / 1000);
+}
+
+// the firmware's settling delays would only slow the benchmarks
+void sleep_ms(uint32_t ms) {
+	(void) ms;
+}
+
+void sleep_us(uint64_t us) {
+	(void) us;
+}
+
+void mutex_init(mutex_t *mtx) {
+	mtx->owned = 0;
+}
+
+void mutex_enter_blocking(mutex_t *mtx) {
+	if (mtx->owned) {
+		fprintf(stderr, "host: mutex re-entered, would deadlock\n");
+		abort();
+	}
+	mtx->owned = 1;
+}
+
+bool mutex_try_enter(mutex_t *mtx, uint32_t *owner_out) {
+	if (mtx->owned) {
+		if (owner_out) {
+			*owner_out = 0;
+		}
+		return false;
+	}
+	mtx->owned = 1;
+	return true;
+}
+
+void mutex_exit(mutex_t *mtx) {
+	mtx->owned = 0;
+}
+
+uint get_core_num(void) {
+	return 0;
+}
+
+#define HOST_DMA_CHANNELS	12
+typedef struct hostsnifferstruct {
+	int channel;
+	uint32_t accumulator;
+	bool reverse;
+	bool invert;
+} HostSniffer;
+
+static uint8_t dma_claimed = 0;
+static HostSniffer sniffer = { .channel = -1 };
+
+static uint32_t sniff_crc32(uint32_t crc, const uint8_t *data, uint32_t len) {
+	for (uint32_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (uint8_t b = 0; b < 8; b++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+	}
+	return crc;
+}
+
+int dma_claim_unused_channel(bool required) {
+	if (dma_claimed >= HOST_DMA_CHANNELS) {
+		if (required) {
+			fprintf(stderr, "host: out of DMA channels\n");
+			abort();
+		}
+		return -1;
+	}
+	return dma_claimed++;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+	(void) channel;
+	dma_channel_config c = { .size = DMA_SIZE_32, .read_increment = true,
+			.write_increment = false, .sniff = false };
+	return c;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c,
+		enum dma_channel_transfer_size size) {
+	c->size = (uint8_t) size;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+	c->read_increment = incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+	c->write_increment = incr;
+}
+
+void channel_config_set_sniff_enable(dma_channel_config *c, bool sniff) {
+	c->sniff = sniff;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+	(void) c;
+	(void) dreq;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config,
+		volatile void *write_addr, const volatile void *read_addr,
+		uint transfer_count, bool trigger) {
+	uint32_t width = 1u << config->size;
+	const uint8_t *src = (const uint8_t*) read_addr;
+	uint8_t *dst = (uint8_t*) write_addr;
+	if (!trigger) {
+		return;
+	}
+	for (uint i = 0; i < transfer_count; i++) {
+		if (dst) {
+			memcpy(dst, src, width);
+		}
+		if (config->sniff && sniffer.channel == (int) channel) {
+			sniffer.accumulator = sniff_crc32(sniffer.accumulator, src, width);
+		}
+		if (config->read_increment) {
+			src += width;
+		}
+		if (config->write_increment) {
+			dst += width;
+		}
+	}
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+	(void) channel;
+}
+
+bool dma_channel_is_busy(uint channel) {
+	(void) channel;
+	return false;
+}
+
+void dma_sniffer_enable(uint channel, uint mode, bool force_channel_enable) {
+	(void) force_channel_enable;
+	if (mode != 0x1) {
+		fprintf(stderr, "host: only the CRC-32 sniffer mode is emulated\n");
+		abort();
+	}
+	sniffer.channel = (int) channel;
+}
+
+void dma_sniffer_disable(void) {
+	sniffer.channel = -1;
+}
+
+void dma_sniffer_set_data_accumulator(uint32_t seed_value) {
+	sniffer.accumulator = seed_value;
+}
+
+uint32_t dma_sniffer_get_data_accumulator(void) {
+	// kept reflected already, which is what output reverse gives
+	return sniffer.invert ? ~sniffer.accumulator : sniffer.accumulator;
+}
+
+void dma_sniffer_set_output_reverse_enabled(bool enable) {
+	sniffer.reverse = enable;
+}
+
+void dma_sniffer_set_output_invert_enabled(bool enable) {
+	sniffer.invert = enable;
+}
+
+void gpio_init(uint gpio) {
+	(void) gpio;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+	(void) gpio;
+	(void) out;
+}
+
+void gpio_put(uint gpio, bool value) {
+	(void) gpio;
+	(void) value;
+}
+
+bool gpio_get(uint gpio) {
+	(void) gpio;
+	return false;
+}
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required) {
+	(void) freq_khz;
+	(void) required;
+	return true;
+}
+
+// board_reboot() goes through the watchdog
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug) {
+	(void) delay_ms;
+	(void) pause_on_debug;
+	host_reboot = true;
+}
+
+bool host_reboot_requested(void) {
+	return host_reboot;
+}
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code,
+		uint8_t add_sense_qualifier) {
+	(void) lun;
+	(void) sense_key;
+	(void) add_sense_code;
+	(void) add_sense_qualifier;
+	return true;
+}
+
+void host_cdc_echo(bool enable) {
+	cdc_echo = enable;
+}
+
+bool tud_cdc_ready(void) {
+	return cdc_echo;
+}
+
+uint32_t tud_cdc_available(void) {
+	return 0;
+}
+
+int32_t tud_cdc_read_char(void) {
+	return -1;
+}
+
+uint32_t tud_cdc_write(const void *buffer, uint32_t bufsize) {
+	if (cdc_echo) {
+		fwrite(buffer, 1, bufsize, stderr);
+	}
+	return bufsize;
+}
+
+uint32_t tud_cdc_write_char(char ch) {
+	return tud_cdc_write(&ch, 1);
+}
+
+uint32_t tud_cdc_write_flush(void) {
+	return 0;
+}
+
+uint32_t tud_cdc_n_write_flush(uint8_t itf) {
+	(void) itf;
+	return 0;
+}
@@ -0,0 +1,5 @@
+/*
+ * watchdog.h, part of the riffpga project, host build shim
+ * (see host_platform.h)
+ */
+#include "host_platform.h"
@@ -0,0 +1,181 @@
+/*
+ * host_platform.h, part of the riffpga project
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Pat Deegan
+ *    Copyright (C) 2026 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Just enough of the pico-sdk and TinyUSB, for building the upload
+ * path (ghostfat, board, bitstream, board_config, msc_disk) on a
+ * normal Linux box.  Everything the pico-sdk/TinyUSB headers named
+ * by board_includes.h would have brought in lands here; those
+ * headers, under host/include, only pull this one in.
+ *
+ * Flash is a file, mmap()ed at XIP_BASE so board.c's XIP reads work
+ * as is.  Erase/program follow NOR rules (erase to 0xff, programming
+ * only clears bits) and insist on the same alignment as the SDK.
+ */
+
+#ifndef HOST_PLATFORM_H_
+#define HOST_PLATFORM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef unsigned int uint;
+
+#define PICO_OK		0
+#define PICO_ERROR_GENERIC	-1
+
+#define __not_in_flash_func(f)	f
+#define __time_critical_func(f)	f
+#define tight_loop_contents()	do {} while (0)
+
+/* flash */
+#define XIP_BASE			0x10000000
+#define FLASH_PAGE_SIZE		(1u << 8)
+#define FLASH_SECTOR_SIZE	(1u << 12)
+#define FLASH_BLOCK_SIZE	(1u << 16)
+#define HOST_FLASH_SIZE		(16 * 1024 * 1024)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+int flash_safe_execute(void (*func)(void*), void *param, uint32_t enter_exit_timeout_ms);
+bool flash_safe_execute_core_init(void);
+
+/*
+ * Maps path (created, and filled with 0xff, if needed) at XIP_BASE.
+ * Returns false, having said why on stderr, if that didn't work.
+ */
+bool host_flash_open(const char *path);
+void host_flash_close(void);
+
+/*
+ * What the flash was asked to do, and how long that would have
+ * taken on the real thing, going by typical datasheet timings
+ * (HOST_FLASH_*_US).  The host itself doesn't wait.
+ */
+#define HOST_FLASH_SECTOR_ERASE_US	45000
+#define HOST_FLASH_BLOCK_ERASE_US	150000
+#define HOST_FLASH_PAGE_PROGRAM_US	400
+
+typedef struct hostflashcountersstruct {
+	uint32_t sector_erases;
+	uint32_t block_erases;
+	uint32_t page_programs;
+	uint64_t modelled_us;
+	uint32_t safe_executes; // flash_safe_execute() calls, XIP off each time
+	uint64_t emulation_ns; // real time the host spent doing it
+} HostFlashCounters;
+
+HostFlashCounters * host_flash_counters(void);
+
+/* time */
+typedef uint64_t absolute_time_t;
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+uint32_t board_millis(void);
+
+/* cores and locking: a single thread here */
+typedef struct { int owned; } mutex_t;
+void mutex_init(mutex_t *mtx);
+void mutex_enter_blocking(mutex_t *mtx);
+bool mutex_try_enter(mutex_t *mtx, uint32_t *owner_out);
+void mutex_exit(mutex_t *mtx);
+uint get_core_num(void);
+
+/*
+ * DMA: transfers happen right away, on configure with trigger set.
+ * The sniffer only does what board.c uses it for, CRC-32 (calc 0x1)
+ * with the output reversed and inverted, i.e. zlib's crc32().
+ */
+enum dma_channel_transfer_size {
+	DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2
+};
+typedef struct {
+	uint8_t size;
+	bool read_increment;
+	bool write_increment;
+	bool sniff;
+} dma_channel_config;
+#define DREQ_FORCE	0x3f
+
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config *c,
+		enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_sniff_enable(dma_channel_config *c, bool sniff);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void dma_channel_configure(uint channel, const dma_channel_config *config,
+		volatile void *write_addr, const volatile void *read_addr,
+		uint transfer_count, bool trigger);
+void dma_channel_wait_for_finish_blocking(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_sniffer_enable(uint channel, uint mode, bool force_channel_enable);
+void dma_sniffer_disable(void);
+void dma_sniffer_set_data_accumulator(uint32_t seed_value);
+uint32_t dma_sniffer_get_data_accumulator(void);
+void dma_sniffer_set_output_reverse_enabled(bool enable);
+void dma_sniffer_set_output_invert_enabled(bool enable);
+
+/* gpio, clocks, watchdog: no-ops, bar the reboot request */
+#define GPIO_IN		false
+#define GPIO_OUT	true
+#define GPIO_IRQ_EDGE_FALL	0x4u
+#define GPIO_IRQ_EDGE_RISE	0x8u
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+bool set_sys_clock_khz(uint32_t freq_khz, bool required);
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug);
+bool host_reboot_requested(void);
+
+typedef struct spi_inst spi_inst_t;
+
+/*
+ * TinyUSB: the MSC callbacks are driven by the replay harness,
+ * CDC output goes to stderr if host_cdc_echo() was turned on.
+ */
+#define BOARD_TUD_RHPORT	0
+#define TU_ATTR_PACKED		__attribute__((packed))
+#define TU_ASSERT(cond, ret)	do { if (!(cond)) { return ret; } } while (0)
+
+#define SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL	0x1E
+#define SCSI_SENSE_NOT_READY		0x02
+#define SCSI_SENSE_ILLEGAL_REQUEST	0x05
+#define SCSI_SENSE_UNIT_ATTENTION	0x06
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code,
+		uint8_t add_sense_qualifier);
+
+bool tud_cdc_ready(void);
+uint32_t tud_cdc_available(void);
+int32_t tud_cdc_read_char(void);
+uint32_t tud_cdc_write(const void *buffer, uint32_t bufsize);
+uint32_t tud_cdc_write_char(char ch);
+uint32_t tud_cdc_write_flush(void);
+uint32_t tud_cdc_n_write_flush(uint8_t itf);
+void host_cdc_echo(bool enable);
+
+#endif /* HOST_PLATFORM_H_ */
@@ -0,0 +1,105 @@
+#!/usr/bin/env python
+'''
+Created on Oct 17, 2026
+
+@author: Pat Deegan
+@copyright: Copyright (C) 2026 Pat Deegan, https://psychogenic.com
+
+Drops a raw DESIGN.bin on a fresh drive with riffpga_host, then
+replays that same copy with its writes in the other orders hosts
+use (FAT first, directory first, a size 0 entry first), each onto
+a fresh drive, and checks SLOT1.BIN reads back as the original.
+
+  raw_drop_orders.py path/to/riffpga_host
+'''
+
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+def parse_trace(path):
+    # [(line, [sector lines])], sector lines only for writes
+    cmds = []
+    with open(path) as f:
+        lines = f.read().split('\n')
+    i = 0
+    while i < len(lines):
+        line = lines[i]
+        i += 1
+        if not line:
+            continue
+        data = []
+        if line.startswith('W '):
+            count = int(line.split()[2])
+            data = lines[i:i + count]
+            i += count
+        cmds.append((line, data))
+    return cmds
+
+def lba_of(cmd):
+    return int(cmd[0].split()[1])
+
+def write_trace(path, cmds):
+    with open(path, 'w') as f:
+        for line, data in cmds:
+            f.write(line + '\n')
+            for d in data:
+                f.write(d + '\n')
+
+def unsized(dircmd):
+    # same directory sector, new entry not yet given a size or cluster
+    line, data = dircmd
+    sector = bytearray.fromhex(data[0])
+    for off in range(0, len(sector), 32):
+        if sector[off:off + 11] == b'DESIGN  BIN':
+            sector[off + 26:off + 32] = bytes(6)
+    return (line, [sector.hex()])
+
+def main():
+    host = sys.argv[1]
+    rng = random.Random(0xd5)
+    design = rng.randbytes(20000)
+    failed = False
+    with tempfile.TemporaryDirectory() as tmp:
+        binpath = os.path.join(tmp, 'DESIGN.bin')
+        with open(binpath, 'wb') as f:
+            f.write(design)
+        recorded = os.path.join(tmp, 'recorded.trace')
+        subprocess.run([host, '-f', os.path.join(tmp, 'rec.img'), '-r', recorded,
+                        'upload', binpath], check=True, stdout=subprocess.DEVNULL)
+
+        # upload writes the data, then the FATs, then the directory
+        cmds = parse_trace(recorded)
+        writes = [c for c in cmds if c[0].startswith('W ')]
+        first_w = cmds.index(writes[0])
+        head, tail = cmds[:first_w], cmds[cmds.index(writes[-1]) + 1:]
+        dirw = writes[-1]
+        fat = [c for c in writes if lba_of(c) < lba_of(dirw)]
+        data = [c for c in writes if lba_of(c) > lba_of(dirw)]
+
+        orders = {
+            'data-fat-dir': data + fat + [dirw],
+            'fat-data-dir': fat + data + [dirw],
+            'dir-fat-data': [dirw] + fat + data,
+            'size0dir-fat-data-dir': [unsized(dirw)] + fat + data + [dirw],
+        }
+        for name, body in orders.items():
+            trace = os.path.join(tmp, f'{name}.trace')
+            image = os.path.join(tmp, f'{name}.img')
+            out = os.path.join(tmp, f'{name}.out')
+            write_trace(trace, head + body + tail)
+            ok = (subprocess.run([host, '-f', image, 'replay', trace],
+                                 stdout=subprocess.DEVNULL).returncode == 0
+                  and subprocess.run([host, '-f', image, 'download', 'SLOT1.BIN', out],
+                                     stdout=subprocess.DEVNULL).returncode == 0)
+            if ok:
+                with open(out, 'rb') as f:
+                    ok = f.read() == design
+            print(f'{name}: {"ok" if ok else "FAILED"}')
+            failed = failed or not ok
+    sys.exit(1 if failed else 0)
+
+if __name__ == "__main__":
+    main()
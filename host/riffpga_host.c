@@ -0,0 +1,787 @@
+/*
+ * riffpga_host.c, part of the riffpga project
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Pat Deegan
+ *    Copyright (C) 2026 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Drives the firmware's MSC callbacks from the command line, against
+ * a flash image file:
+ *
+ *   replay TRACE      play back a SCSI trace (format below)
+ *   upload FILE.uf2   do what a host copying FILE.uf2 onto the drive
+ *                     does: look at the FS, write the file, poll.  A
+ *                     FILE.bin (anything not UF2) gets a FAT chain
+ *                     and directory entry too, as a new file would
+ *   download NAME OUT copy NAME (e.g. SLOT1.BIN) off the drive
+ *   bench FILE.uf2    blocks/sec through uf2_write_block() (uploading
+ *                     FILE.uf2 again and again) and uf2_read_block()
+ *                     (reading the whole volume)
+ *   mount             what mounting the drive and listing it cost
+ *   track KB          board.c's erase/program bookkeeping per 256
+ *                     byte block, over uploads of KB
+ *   rle RAW PACKED    expand PACKED (the packager's --compress output)
+ *                     with bs_rle.c, check it against RAW and time it
+ *
+ * Traces are text, one command per line, '#' starts a comment:
+ *
+ *   T                 TEST UNIT READY
+ *   R lba count       READ10
+ *   W lba count       WRITE10, followed by count lines of sector
+ *                     data, 512 bytes as 1024 hex digits each
+ *
+ * Transfers are handed over CFG_TUD_MSC_EP_BUFSIZE bytes at a time,
+ * as TinyUSB does, and when a write callback returns busy the main
+ * loop's board_flash_task() and uf2_task() get a pass before the
+ * retry.  They also get one after every chunk, standing in for the
+ * main loop running while the next packet comes in.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+#include "board.h"
+#include "board_config.h"
+#include "bs_rle.h"
+#include "uf2.h"
+
+#define HOST_MSC_EP_BUFSIZE	512 /* as CFG_TUD_MSC_EP_BUFSIZE */
+#define HOST_SECTOR_SIZE	512
+#define HOST_WRITE_MAX_SECTORS	128 /* what Linux usually sends per WRITE10 */
+
+// implemented by msc_disk.c
+bool tud_msc_test_unit_ready_cb(uint8_t lun);
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
+		void *buffer, uint32_t bufsize);
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
+		uint8_t *buffer, uint32_t bufsize);
+void tud_msc_write10_complete_cb(uint8_t lun);
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count,
+		uint16_t *block_size);
+
+typedef struct replaystatsstruct {
+	uint32_t commands;
+	uint32_t sectors_read;
+	uint32_t sectors_written;
+	uint32_t busy_returns;
+	uint64_t read_us;
+	uint64_t write_us;
+} ReplayStats;
+
+static ReplayStats replay_stats;
+static FILE *record_to = NULL;
+
+static void host_setup(void) {
+	// as main.c's setup(), minus the hardware
+	board_flash_init();
+	uf2_init();
+	boardconfig_init();
+	if (boardconfig_version_mismatch() == true) {
+		boardconfig_factoryreset(true);
+	}
+}
+
+static void record_sectors(const uint8_t *data, uint32_t count) {
+	for (uint32_t s = 0; s < count; s++) {
+		for (uint32_t i = 0; i < HOST_SECTOR_SIZE; i++) {
+			fprintf(record_to, "%02x", data[(s * HOST_SECTOR_SIZE) + i]);
+		}
+		fputc('\n', record_to);
+	}
+}
+
+// what run_tasks() does about the drive
+static void main_loop_pass(void) {
+	board_flash_task();
+	uf2_task();
+}
+
+static void scsi_test_unit_ready(void) {
+	if (record_to) {
+		fprintf(record_to, "T\n");
+	}
+	replay_stats.commands++;
+	tud_msc_test_unit_ready_cb(0);
+	main_loop_pass();
+}
+
+static void scsi_read10(uint32_t lba, uint32_t count, uint8_t *data) {
+	if (record_to) {
+		fprintf(record_to, "R %u %u\n", lba, count);
+	}
+	replay_stats.commands++;
+	uint64_t tstart = time_us_64();
+	for (uint32_t s = 0; s < count; s++) {
+		tud_msc_read10_cb(0, lba + s, 0, &data[s * HOST_SECTOR_SIZE],
+				HOST_MSC_EP_BUFSIZE);
+	}
+	replay_stats.read_us += time_us_64() - tstart;
+	replay_stats.sectors_read += count;
+	main_loop_pass();
+}
+
+static void scsi_write10(uint32_t lba, uint32_t count, uint8_t *data) {
+	if (record_to) {
+		fprintf(record_to, "W %u %u\n", lba, count);
+		record_sectors(data, count);
+	}
+	replay_stats.commands++;
+	uint64_t tstart = time_us_64();
+	uint32_t total = count * HOST_SECTOR_SIZE;
+	uint32_t xferred = 0;
+	while (xferred < total) {
+		int32_t rv = tud_msc_write10_cb(0, lba + (xferred / HOST_SECTOR_SIZE),
+				0, &data[xferred], HOST_MSC_EP_BUFSIZE);
+		if (rv < 0) {
+			fprintf(stderr, "WRITE10 @%u failed\n",
+					lba + (xferred / HOST_SECTOR_SIZE));
+			break;
+		}
+		if (rv == 0) {
+			replay_stats.busy_returns++;
+		}
+		xferred += (uint32_t) rv;
+		main_loop_pass();
+	}
+	tud_msc_write10_complete_cb(0);
+	replay_stats.write_us += time_us_64() - tstart;
+	replay_stats.sectors_written += count;
+}
+
+static int hexval(int c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f') {
+		return 10 + c - 'a';
+	}
+	return -1;
+}
+
+static bool read_hex_sector(FILE *f, uint8_t *out) {
+	char line[(HOST_SECTOR_SIZE * 2) + 8];
+	if (!fgets(line, sizeof(line), f)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < HOST_SECTOR_SIZE; i++) {
+		int hi = hexval(line[i * 2]);
+		int lo = hexval(line[(i * 2) + 1]);
+		if (hi < 0 || lo < 0) {
+			return false;
+		}
+		out[i] = (uint8_t) ((hi << 4) | lo);
+	}
+	return true;
+}
+
+static bool replay(const char *path) {
+	FILE *f = fopen(path, "r");
+	char line[128];
+	uint32_t lineno = 0;
+	if (!f) {
+		perror(path);
+		return false;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		char op = 0;
+		uint32_t lba = 0, count = 0;
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		int n = sscanf(line, " %c %u %u", &op, &lba, &count);
+		if (op == 'T' && n >= 1) {
+			scsi_test_unit_ready();
+		} else if ((op == 'R' || op == 'W') && n == 3) {
+			uint8_t *data = malloc(count * HOST_SECTOR_SIZE);
+			if (!data) {
+				fclose(f);
+				return false;
+			}
+			if (op == 'R') {
+				scsi_read10(lba, count, data);
+			} else {
+				for (uint32_t s = 0; s < count; s++) {
+					if (!read_hex_sector(f, &data[s * HOST_SECTOR_SIZE])) {
+						fprintf(stderr, "%s:%u: bad sector data\n", path, lineno);
+						free(data);
+						fclose(f);
+						return false;
+					}
+					lineno++;
+				}
+				scsi_write10(lba, count, data);
+			}
+			free(data);
+		} else {
+			fprintf(stderr, "%s:%u: can't parse '%s'\n", path, lineno, line);
+			fclose(f);
+			return false;
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+static uint8_t* load_file(const char *path, uint32_t *len, uint32_t *size) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	long sz = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	// whole sectors, as the host would send them
+	uint32_t padded = ((sz + HOST_SECTOR_SIZE - 1) / HOST_SECTOR_SIZE)
+			* HOST_SECTOR_SIZE;
+	uint8_t *buf = calloc(1, padded ? padded : HOST_SECTOR_SIZE);
+	if (buf && fread(buf, 1, sz, f) != (size_t) sz) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*len = padded;
+	*size = (uint32_t) sz;
+	return buf;
+}
+
+static uint16_t le16(const uint8_t *p) {
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+typedef struct fslayoutstruct {
+	uint32_t fat_start;
+	uint32_t fat_sectors;
+	uint32_t num_fats;
+	uint32_t root_start;
+	uint32_t root_sectors;
+	uint32_t data_start;
+} FSLayout;
+
+// read the boot sector, as any host starts with
+static bool read_layout(FSLayout *fs) {
+	uint8_t boot[HOST_SECTOR_SIZE];
+	scsi_read10(0, 1, boot);
+	fs->fat_start = le16(&boot[14]);
+	fs->fat_sectors = le16(&boot[22]);
+	fs->num_fats = boot[16];
+	fs->root_sectors = (le16(&boot[17]) * 32) / HOST_SECTOR_SIZE;
+	fs->root_start = fs->fat_start + (fs->num_fats * fs->fat_sectors);
+	fs->data_start = fs->root_start + fs->root_sectors;
+	if (le16(&boot[11]) != HOST_SECTOR_SIZE || !fs->fat_sectors) {
+		fprintf(stderr, "Boot sector doesn't look like FAT\n");
+		return false;
+	}
+	return true;
+}
+
+static void write_sectors(uint32_t lba, uint32_t sectors, const uint8_t *data) {
+	for (uint32_t s = 0; s < sectors; s += HOST_WRITE_MAX_SECTORS) {
+		uint32_t count = sectors - s;
+		if (count > HOST_WRITE_MAX_SECTORS) {
+			count = HOST_WRITE_MAX_SECTORS;
+		}
+		scsi_write10(lba + s, count, (uint8_t*) &data[s * HOST_SECTOR_SIZE]);
+	}
+}
+
+// 8.3, upper case, from the last path component
+static void dos_name(const char *path, uint8_t name[11]) {
+	const char *base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+	const char *dot = strrchr(base, '.');
+	memset(name, ' ', 11);
+	for (uint8_t i = 0; i < 8 && base[i] && &base[i] != dot; i++) {
+		name[i] = (uint8_t) toupper((unsigned char) base[i]);
+	}
+	for (uint8_t i = 0; dot && i < 3 && dot[i + 1]; i++) {
+		name[8 + i] = (uint8_t) toupper((unsigned char) dot[i + 1]);
+	}
+}
+
+/*
+ * Creating a file that isn't UF2, as a host does: free clusters from
+ * the FAT, the data, then both FATs and the directory entry.
+ */
+static bool write_new_file(const FSLayout *fs, uint8_t *fat, uint8_t *root,
+		const uint8_t *file, uint32_t len, uint32_t size, const char *path) {
+	uint16_t *entries = (uint16_t*) fat;
+	uint32_t num_entries = (fs->fat_sectors * HOST_SECTOR_SIZE) / 2;
+	uint32_t sectors = len / HOST_SECTOR_SIZE;
+	uint16_t first = 0, prev = 0;
+	uint32_t dirty_lo = fs->fat_sectors, dirty_hi = 0;
+	uint32_t found = 0;
+	for (uint32_t c = 2; c < num_entries && found < sectors; c++) {
+		if (entries[c]) {
+			continue;
+		}
+		if (prev) {
+			entries[prev] = (uint16_t) c;
+		} else {
+			first = (uint16_t) c;
+		}
+		// one sector per cluster on this drive
+		scsi_write10(fs->data_start + (c - 2), 1,
+				(uint8_t*) &file[found * HOST_SECTOR_SIZE]);
+		entries[c] = 0xFFFF;
+		prev = (uint16_t) c;
+		found++;
+		if ((c * 2) / HOST_SECTOR_SIZE < dirty_lo) {
+			dirty_lo = (c * 2) / HOST_SECTOR_SIZE;
+		}
+		dirty_hi = (c * 2) / HOST_SECTOR_SIZE;
+	}
+	if (found < sectors) {
+		fprintf(stderr, "Drive is full\n");
+		return false;
+	}
+
+	uint8_t *d = root;
+	uint32_t num_dirents = (fs->root_sectors * HOST_SECTOR_SIZE) / 32;
+	uint32_t e;
+	for (e = 0; e < num_dirents; e++, d += 32) {
+		if (d[0] == 0 || d[0] == 0xE5) {
+			break;
+		}
+	}
+	if (e == num_dirents) {
+		fprintf(stderr, "Root directory is full\n");
+		return false;
+	}
+	memset(d, 0, 32);
+	dos_name(path, d);
+	d[11] = 0x20; // archive
+	d[26] = (uint8_t) first;
+	d[27] = (uint8_t) (first >> 8);
+	for (uint8_t b = 0; b < 4; b++) {
+		d[28 + b] = (uint8_t) (size >> (8 * b));
+	}
+
+	if (dirty_hi >= dirty_lo) {
+		for (uint32_t f = 0; f < fs->num_fats; f++) {
+			write_sectors(fs->fat_start + (f * fs->fat_sectors) + dirty_lo,
+					dirty_hi - dirty_lo + 1, &fat[dirty_lo * HOST_SECTOR_SIZE]);
+		}
+	}
+	scsi_write10(fs->root_start + ((e * 32) / HOST_SECTOR_SIZE), 1,
+			&root[((e * 32) / HOST_SECTOR_SIZE) * HOST_SECTOR_SIZE]);
+	return true;
+}
+
+/*
+ * A host copying a file over: boot sector, FAT and root directory
+ * reads, then the file into the data region in WRITE10s of up to
+ * HOST_WRITE_MAX_SECTORS, then polling the unit.  Anything that isn't
+ * UF2 is created as a proper file instead, which the firmware takes
+ * as a raw bitstream if it's a .bin.
+ */
+static bool upload(const uint8_t *file, uint32_t len, uint32_t size,
+		const char *path) {
+	FSLayout fs;
+	bool ok = true;
+	scsi_test_unit_ready();
+	if (!read_layout(&fs)) {
+		return false;
+	}
+
+	uint8_t *scratch = malloc((fs.fat_sectors + fs.root_sectors)
+			* HOST_SECTOR_SIZE);
+	if (!scratch) {
+		return false;
+	}
+	uint8_t *root = &scratch[fs.fat_sectors * HOST_SECTOR_SIZE];
+	scsi_read10(fs.fat_start, fs.fat_sectors, scratch);
+	scsi_read10(fs.root_start, fs.root_sectors, root);
+
+	if (size >= 4 && (le16(file) | ((uint32_t) le16(&file[2]) << 16))
+			== UF2_MAGIC_START0) {
+		write_sectors(fs.data_start, len / HOST_SECTOR_SIZE, file);
+	} else {
+		ok = write_new_file(&fs, scratch, root, file, len, size, path);
+	}
+	free(scratch);
+	scsi_test_unit_ready();
+	// let anything still deferred finish, as the idle main loop would
+	while (board_flash_write_pending() || board_flash_preerase_pending()) {
+		board_flash_task();
+	}
+	return ok;
+}
+
+/*
+ * A host copying NAME off the drive: root directory, FAT, then the
+ * file's cluster chain, into out_path.
+ */
+static bool download(const char *name, const char *out_path) {
+	FSLayout fs;
+	uint8_t dos[11];
+	bool ok = false;
+	if (!read_layout(&fs)) {
+		return false;
+	}
+	uint8_t *scratch = malloc((fs.fat_sectors + fs.root_sectors)
+			* HOST_SECTOR_SIZE);
+	if (!scratch) {
+		return false;
+	}
+	uint8_t *root = &scratch[fs.fat_sectors * HOST_SECTOR_SIZE];
+	const uint16_t *entries = (const uint16_t*) scratch;
+	scsi_read10(fs.fat_start, fs.fat_sectors, scratch);
+	scsi_read10(fs.root_start, fs.root_sectors, root);
+
+	dos_name(name, dos);
+	const uint8_t *d = root;
+	uint32_t num_dirents = (fs.root_sectors * HOST_SECTOR_SIZE) / 32;
+	uint32_t e;
+	for (e = 0; e < num_dirents && d[0]; e++, d += 32) {
+		if (d[0] != 0xE5 && !(d[11] & 0x18) && !memcmp(d, dos, 11)) {
+			break;
+		}
+	}
+	FILE *out = NULL;
+	if (e == num_dirents || !d[0]) {
+		fprintf(stderr, "%s: not on the drive\n", name);
+	} else if (!(out = fopen(out_path, "wb"))) {
+		perror(out_path);
+	} else {
+		uint8_t sector[HOST_SECTOR_SIZE];
+		uint32_t left = d[28] | (d[29] << 8) | (d[30] << 16)
+				| ((uint32_t) d[31] << 24);
+		uint16_t cluster = le16(&d[26]);
+		while (left && cluster >= 2 && cluster < 0xFFF0) {
+			uint32_t len = (left > HOST_SECTOR_SIZE) ? HOST_SECTOR_SIZE : left;
+			// one sector per cluster on this drive
+			scsi_read10(fs.data_start + (cluster - 2), 1, sector);
+			fwrite(sector, 1, len, out);
+			left -= len;
+			cluster = entries[cluster];
+		}
+		ok = (left == 0);
+		if (!ok) {
+			fprintf(stderr, "%s: cluster chain ends early\n", name);
+		}
+		fclose(out);
+	}
+	free(scratch);
+	return ok;
+}
+
+static double per_sec(uint32_t count, uint64_t us) {
+	return us ? ((double) count * 1000000.0) / (double) us : 0;
+}
+
+static void report(void) {
+	const HostFlashCounters *hc = host_flash_counters();
+	const BoardFlashStats *fs = board_flash_stats();
+	printf("commands: %u, sectors read: %u (%.0f/s), written: %u (%.0f/s), "
+			"busy returns: %u\n", replay_stats.commands,
+			replay_stats.sectors_read,
+			per_sec(replay_stats.sectors_read, replay_stats.read_us),
+			replay_stats.sectors_written,
+			per_sec(replay_stats.sectors_written, replay_stats.write_us),
+			replay_stats.busy_returns);
+	printf("flash: %u sector erases, %u 64k erases, %u page programs "
+			"in %u flash_safe_execute() calls, ~%.1f ms on real flash\n",
+			hc->sector_erases, hc->block_erases, hc->page_programs,
+			hc->safe_executes, (double) hc->modelled_us / 1000.0);
+	printf("board: %u erases (%u avoided), %u identical blocks, "
+			"%u double writes\n", fs->erases + fs->block_erases,
+			fs->erases_skipped, fs->blocks_identical, fs->double_writes);
+	if (host_reboot_requested()) {
+		printf("firmware asked for a reboot\n");
+	}
+}
+
+static bool bench(const uint8_t *file, uint32_t len, uint32_t size,
+		const char *path, uint32_t iterations) {
+	uint32_t block_count = 0;
+	uint16_t block_size = 0;
+	tud_msc_capacity_cb(0, &block_count, &block_size);
+	uint8_t *sector = malloc(block_size);
+	if (!sector) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		memset(&replay_stats, 0, sizeof(replay_stats));
+		uint64_t tstart = time_us_64();
+		if (!upload(file, len, size, path)) {
+			free(sector);
+			return false;
+		}
+		uint64_t elapsed = time_us_64() - tstart;
+		printf("upload %u: %u blocks in %.2f ms, %.0f blocks/s "
+				"(%.0f/s in write callbacks), %u busy returns\n", i + 1,
+				replay_stats.sectors_written, (double) elapsed / 1000.0,
+				per_sec(replay_stats.sectors_written, elapsed),
+				per_sec(replay_stats.sectors_written, replay_stats.write_us),
+				replay_stats.busy_returns);
+	}
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		uint64_t tstart = time_us_64();
+		for (uint32_t lba = 0; lba < block_count; lba++) {
+			uf2_read_block(lba, sector);
+		}
+		uint64_t elapsed = time_us_64() - tstart;
+		printf("read %u: %u blocks in %.2f ms, %.0f blocks/s\n", i + 1,
+				block_count, (double) elapsed / 1000.0,
+				per_sec(block_count, elapsed));
+	}
+	free(sector);
+	return true;
+}
+
+/*
+ * Mounting: the boot sector, every FAT and the root directory, as
+ * a host checking the volume does.  Listing: the root directory,
+ * which hosts re-read after each write or medium change.
+ */
+static bool mount_bench(uint32_t iterations) {
+	FSLayout fs;
+	uint64_t mount_us = 0;
+	uint64_t ls_us = 0;
+	if (!read_layout(&fs)) {
+		return false;
+	}
+	uint32_t fat_total = fs.num_fats * fs.fat_sectors;
+	uint8_t *scratch = malloc((fat_total + fs.root_sectors) * HOST_SECTOR_SIZE);
+	if (!scratch) {
+		return false;
+	}
+	for (uint32_t i = 0; i < iterations; i++) {
+		uint64_t tstart = time_us_64();
+		scsi_test_unit_ready();
+		read_layout(&fs);
+		scsi_read10(fs.fat_start, fat_total, scratch);
+		scsi_read10(fs.root_start, fs.root_sectors, scratch);
+		mount_us += time_us_64() - tstart;
+
+		tstart = time_us_64();
+		scsi_read10(fs.root_start, fs.root_sectors, scratch);
+		ls_us += time_us_64() - tstart;
+	}
+	free(scratch);
+	printf("mount: %u sectors, %.2f us each time, %.0f sectors/s\n",
+			1 + fat_total + fs.root_sectors,
+			(double) mount_us / (double) iterations,
+			per_sec(iterations * (1 + fat_total + fs.root_sectors), mount_us));
+	printf("ls: %u sectors, %.2f us each time\n", fs.root_sectors,
+			(double) ls_us / (double) iterations);
+	return true;
+}
+
+/*
+ * The decompressor as bs_program_from() drives it, a transfer
+ * block at a time: the round trip first, then N timed passes.
+ */
+static bool rle_check(const char *raw_path, const char *packed_path,
+		uint32_t iterations) {
+	uint32_t raw_len = 0, raw_size = 0, packed_len = 0, packed_size = 0;
+	uint8_t block[FLASH_SPI_XFER_BLOCKSIZE];
+	BS_RLE_State rle;
+	uint16_t len;
+	bool ok = false;
+	uint8_t *raw = load_file(raw_path, &raw_len, &raw_size);
+	uint8_t *packed = load_file(packed_path, &packed_len, &packed_size);
+	if (!raw || !packed) {
+		goto done;
+	}
+
+	uint32_t pos = 0;
+	bs_rle_init(&rle, packed, packed_size);
+	while ((len = bs_rle_read(&rle, block, sizeof(block)))) {
+		if ((pos + len) > raw_size || memcmp(&raw[pos], block, len)) {
+			fprintf(stderr, "rle: mismatch in block @%u\n", pos);
+			goto done;
+		}
+		pos += len;
+	}
+	if (pos != raw_size) {
+		fprintf(stderr, "rle: expanded to %u bytes, expected %u\n", pos,
+				raw_size);
+		goto done;
+	}
+
+	uint64_t tstart = time_us_64();
+	for (uint32_t i = 0; i < iterations; i++) {
+		bs_rle_init(&rle, packed, packed_size);
+		while (bs_rle_read(&rle, block, sizeof(block))) {
+		}
+	}
+	uint64_t elapsed = time_us_64() - tstart;
+	printf("rle: %u bytes from %u (%.1f%%), round trip ok, %.1f MB/s "
+			"decoding\n", raw_size, packed_size,
+			raw_size ? (100.0 * packed_size) / raw_size : 0,
+			per_sec(iterations * raw_size, elapsed) / 1e6);
+	ok = true;
+done:
+	free(raw);
+	free(packed);
+	return ok;
+}
+
+/*
+ * board.c's own cost per 256 byte UF2 payload: KB of fresh data
+ * written at slot 1 through board_flash_write_buffered(), with
+ * the erase tracking cleared in between as uf2_init() does, less
+ * the time the host spends standing in for the flash itself.
+ */
+static bool track_bench(uint32_t kbytes, uint32_t iterations) {
+	uint8_t block[256];
+	uint32_t base = FLASH_STORAGE_STARTADDRESS(0);
+	uint32_t blocks = (kbytes * 1024) / sizeof(block);
+	uint64_t elapsed_us = 0;
+	uint64_t emulation_ns = 0;
+	if (!blocks || (base + (blocks * sizeof(block))) > HOST_FLASH_SIZE) {
+		fprintf(stderr, "track: %u KB doesn't fit\n", kbytes);
+		return false;
+	}
+	for (uint32_t i = 0; i < iterations; i++) {
+		board_flash_pages_erased_clear();
+		board_flash_session_start();
+		uint64_t emu_before = host_flash_counters()->emulation_ns;
+		uint64_t tstart = time_us_64();
+		for (uint32_t b = 0; b < blocks; b++) {
+			// differs every pass, so nothing gets skipped as identical
+			memset(block, (uint8_t) (b + i), sizeof(block));
+			board_flash_write_buffered(base + (b * sizeof(block)), block,
+					sizeof(block));
+		}
+		board_flash_flush();
+		elapsed_us += time_us_64() - tstart;
+		emulation_ns += host_flash_counters()->emulation_ns - emu_before;
+	}
+	double total_ns = (double) elapsed_us * 1000.0;
+	double per_block = (total_ns - (double) emulation_ns)
+			/ ((double) blocks * iterations);
+	printf("track: %u blocks over %u sectors, %.1f ns/block in board.c "
+			"(%.1f with flash emulation)\n", blocks,
+			(blocks + 15) / 16, per_block,
+			total_ns / ((double) blocks * iterations));
+	return true;
+}
+
+// operands after the command name
+static int command_args(const char *cmd) {
+	if (strcmp(cmd, "mount") == 0) {
+		return 0;
+	}
+	if (strcmp(cmd, "rle") == 0 || strcmp(cmd, "download") == 0) {
+		return 2;
+	}
+	return 1;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+			"Usage: %s [-f flash.img] [-v] [-r out.trace] [-n N] COMMAND ARG...\n"
+			"  replay TRACE      play back a SCSI trace\n"
+			"  upload FILE       copy FILE (.uf2 or raw .bin) onto the drive\n"
+			"  download NAME OUT copy NAME off the drive, into OUT\n"
+			"  bench FILE.uf2    upload/read throughput, N times (default 5)\n"
+			"  mount             mount/ls latency, over N times\n"
+			"  track KB          board.c bookkeeping per block, N KB uploads\n"
+			"  rle RAW PACKED    check/time bs_rle.c expanding PACKED, N times\n"
+			"  -f  flash image, created if needed (default flash.img)\n"
+			"  -v  show the firmware's CDC output on stderr\n"
+			"  -r  record the SCSI commands issued as a trace\n", prog);
+}
+
+int main(int argc, char **argv) {
+	const char *image = "flash.img";
+	const char *record_path = NULL;
+	uint32_t iterations = 5;
+	int opt;
+	bool ok = false;
+
+	while ((opt = getopt(argc, argv, "f:vr:n:")) != -1) {
+		switch (opt) {
+		case 'f':
+			image = optarg;
+			break;
+		case 'v':
+			host_cdc_echo(true);
+			break;
+		case 'r':
+			record_path = optarg;
+			break;
+		case 'n':
+			iterations = (uint32_t) strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	int nargs = argc - optind;
+	if (nargs < 1 || nargs != 1 + command_args(argv[optind])) {
+		usage(argv[0]);
+		return 2;
+	}
+	const char *cmd = argv[optind];
+	const char *arg = argv[optind + 1];
+
+	if (strcmp(cmd, "rle") == 0) {
+		// no drive involved
+		return rle_check(arg, argv[optind + 2], iterations) ? 0 : 1;
+	}
+
+	if (!host_flash_open(image)) {
+		return 1;
+	}
+	if (record_path && !(record_to = fopen(record_path, "w"))) {
+		perror(record_path);
+		return 1;
+	}
+	host_setup();
+
+	if (strcmp(cmd, "mount") == 0) {
+		ok = mount_bench(iterations);
+	} else if (strcmp(cmd, "download") == 0) {
+		ok = download(arg, argv[optind + 2]);
+	} else if (strcmp(cmd, "track") == 0) {
+		ok = track_bench((uint32_t) strtoul(arg, NULL, 0), iterations);
+	} else if (strcmp(cmd, "replay") == 0) {
+		ok = replay(arg);
+		report();
+	} else if (strcmp(cmd, "upload") == 0 || strcmp(cmd, "bench") == 0) {
+		uint32_t len = 0, size = 0;
+		uint8_t *file = load_file(arg, &len, &size);
+		if (file) {
+			if (cmd[0] == 'u') {
+				ok = upload(file, len, size, arg);
+				report();
+			} else {
+				ok = bench(file, len, size, arg, iterations);
+			}
+			free(file);
+		}
+	} else {
+		usage(argv[0]);
+	}
+
+	if (record_to) {
+		fclose(record_to);
+	}
+	host_flash_close();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#!/usr/bin/env python
+'''
+Created on Oct 17, 2026
+
+@author: Pat Deegan
+@copyright: Copyright (C) 2026 Pat Deegan, https://psychogenic.com
+
+Packs a few bitstream-sized inputs with the packager's --compress
+encoder and has riffpga_host expand them through the firmware's
+bs_rle.c, checking the round trip and reporting decode throughput.
+
+  rle_roundtrip.py path/to/riffpga_host [iterations]
+'''
+
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'bin'))
+from bitstream_to_uf2 import rle_compress
+
+# an iCE40 UP5K bitstream
+bitstream_size = 104090
+
+def bitstream_like(rng:random.Random):
+    # long blank stretches between bursts of configuration data
+    out = bytearray()
+    while len(out) < bitstream_size:
+        if rng.random() < 0.5:
+            out.extend(bytes(rng.randint(1, 2000)))
+        else:
+            out.extend(rng.randbytes(rng.randint(1, 600)))
+    return bytes(out[:bitstream_size])
+
+def main():
+    host = sys.argv[1]
+    iterations = sys.argv[2] if len(sys.argv) > 2 else '20'
+    rng = random.Random(0x5eed)
+    inputs = {
+        'random': bitstream_like(rng),
+        'zeros': bytes(bitstream_size),
+        'incompressible': rng.randbytes(bitstream_size),
+    }
+    failed = False
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, raw in inputs.items():
+            rawpath = os.path.join(tmp, f'{name}.bin')
+            packedpath = os.path.join(tmp, f'{name}.rle')
+            with open(rawpath, 'wb') as f:
+                f.write(raw)
+            with open(packedpath, 'wb') as f:
+                f.write(rle_compress(raw))
+            print(f'{name}: ', end='', flush=True)
+            if subprocess.run([host, '-n', iterations, 'rle', rawpath, packedpath]).returncode:
+                failed = True
+    sys.exit(1 if failed else 0)
+
+if __name__ == "__main__":
+    main()
@@ -26,6 +26,9 @@
 #include "fpga.h"
 #include "board_config.h"
 #include "driver_state.h"
+#include "bs_rle.h"
+#include "prog_stats.h"
+#include "bs_cache.h"
 
 // define BS_DEBUG_ENABLE
 #ifdef BS_DEBUG_ENABLE
@@ -79,6 +82,18 @@ const Bitstream_Settings * bs_settings_get(void) {
 uint32_t bs_file_size(void) {
 	return bs_marker_state.settings.size;
 }
+bool bs_is_compressed(void) {
+	return (bs_marker_state.settings.user_info.flags & BITSTREAM_FLAG_COMPRESSED_RLE) != 0;
+}
+static uint32_t bs_stream_size_of(const Bitstream_Marker_State * mstate) {
+	if (mstate->settings.user_info.flags & BITSTREAM_FLAG_COMPRESSED_RLE) {
+		return mstate->settings.user_info.bssize;
+	}
+	return mstate->settings.size;
+}
+uint32_t bs_stream_size(void) {
+	return bs_stream_size_of(&bs_marker_state);
+}
 uint32_t bs_uf2_file_size(void) {
 	return bs_marker_state.settings.uf2_file_size;
 }
@@ -205,6 +220,7 @@ void bs_write_marker_to_slot(uint8_t slotidx, uint32_t num_blocks,
 	board_flash_write(boardconfig_bs_marker_address_for(slotidx),
 			&bs_marker_state.info, sizeof(bs_marker_state.info));
 	board_flash_pages_erased_clear();
+	bs_cache_invalidate();
 }
 
 void bs_erase_slot(uint8_t slot) {
@@ -214,72 +230,184 @@ void bs_erase_slot(uint8_t slot) {
 			sizeof(bs_marker_state.info));
 
 	board_flash_pages_erased_clear();
+	bs_cache_invalidate();
 }
 void bs_erase_all(void) {
 	for (uint8_t i = 0; i < POSITION_SLOTS_NUM; i++) {
 			bs_erase_slot(i);
 	}
+	// markers are enough to empty the slots, actually blanking them
+	// (64k at a time, from the main loop) spares the next uploads
+	// the erases
+	board_flash_wipe(FLASH_STORAGE_STARTADDRESS(0),
+			FLASH_STORAGE_STARTADDRESS(POSITION_SLOTS_NUM)
+					- FLASH_STORAGE_STARTADDRESS(0));
 }
 
-bool bs_program_fpga(bs_prog_yield_cb cb) {
-
-	uint8_t xfer_block[FLASH_SPI_XFER_BLOCKSIZE];
+/*
+ * Ping-pong buffers for streaming: while one is being
+ * shifted out to the FPGA by DMA, the other is being filled
+ * from flash by a second DMA channel.
+ */
+static uint8_t xfer_block[2][FLASH_SPI_XFER_BLOCKSIZE];
 
-	if (!bs_have_checked_for_marker()) {
-		if (!bs_check_for_marker()) {
-			BS_DEBUG_LN("No bitstream in flash?");
-			return false;
-		}
+static uint16_t bs_xfer_size(uint32_t cur_addr, uint32_t end_addr) {
+	if ((cur_addr + FLASH_SPI_XFER_BLOCKSIZE) >= end_addr) {
+		return (uint16_t) (end_addr - cur_addr);
 	}
+	return FLASH_SPI_XFER_BLOCKSIZE;
+}
 
-	fpga_enter_programming_mode();
-	uint32_t cur_addr = bs_marker_state.settings.start_address;
-	uint32_t end_addr = bs_marker_state.settings.start_address + bs_marker_state.settings.size;
+/*
+ * progress/abort are shared with whichever core isn't
+ * doing the streaming
+ */
+static volatile uint32_t bs_prog_bytes_streamed = 0;
+static volatile bool bs_prog_abort_requested = false;
+static volatile bool bs_prog_crc_mismatch = false;
+
+uint32_t bs_program_progress(void) {
+	return bs_prog_bytes_streamed;
+}
+
+void bs_program_abort(void) {
+	bs_prog_abort_requested = true;
+}
+
+void bs_program_abort_clear(void) {
+	bs_prog_abort_requested = false;
+}
+
+bool bs_program_aborted(void) {
+	return bs_prog_abort_requested;
+}
+
+bool bs_program_crc_failed(void) {
+	return bs_prog_crc_mismatch;
+}
+
+/*
+ * flash (XIP) to FPGA, optionally leaving a copy of what
+ * was clocked out in cache_fill.  Caller holds the flash lock.
+ */
+static uint32_t bs_stream_from_flash(const Bitstream_Marker_State * mstate, bs_prog_yield_cb cb,
+		uint8_t * cache_fill, uint32_t cache_len) {
+	uint32_t cur_addr = mstate->settings.start_address;
+	uint32_t end_addr = mstate->settings.start_address + mstate->settings.size;
 	BS_DEBUG("FLSH prog "); BS_DEBUG_U32(cur_addr); BS_DEBUG("-"); BS_DEBUG_U32_LN(end_addr);
 
+	/*
+	 * compressed slots get expanded by the CPU into the idle
+	 * buffer while DMA is feeding the other one to the FPGA,
+	 * raw slots are just DMA'ed out of XIP.
+	 */
+	bool compressed = (mstate->settings.user_info.flags & BITSTREAM_FLAG_COMPRESSED_RLE) != 0;
+	BS_RLE_State rle;
+
+	uint8_t bufidx = 0;
 	uint16_t xfer_size;
 	uint32_t total_xfered = 0;
 #ifdef BS_DEBUG_ENABLE
 	uint32_t bytes_sum = 0;
 #endif
-	while (cur_addr < end_addr) {
-		xfer_size = FLASH_SPI_XFER_BLOCKSIZE;
-		if ((cur_addr + xfer_size) >= end_addr) {
-			xfer_size = (uint16_t) (end_addr - cur_addr);
+
+	// prime the first buffer, everything after that overlaps
+	if (compressed) {
+		bs_rle_init(&rle, board_flash_xip(cur_addr), mstate->settings.size);
+		xfer_size = bs_rle_read(&rle, xfer_block[bufidx], FLASH_SPI_XFER_BLOCKSIZE);
+	} else {
+		xfer_size = bs_xfer_size(cur_addr, end_addr);
+		board_flash_read(cur_addr, xfer_block[bufidx], xfer_size);
+	}
+	while (xfer_size) {
+		uint32_t next_addr = cur_addr + xfer_size;
+		uint16_t next_size;
+
+		fpga_spi_write_start(xfer_block[bufidx], xfer_size);
+		if (cache_fill != NULL && (total_xfered + xfer_size) <= cache_len) {
+			memcpy(&cache_fill[total_xfered], xfer_block[bufidx], xfer_size);
+		}
+		if (compressed) {
+			next_size = bs_rle_read(&rle, xfer_block[bufidx ^ 1], FLASH_SPI_XFER_BLOCKSIZE);
+		} else {
+			next_size = bs_xfer_size(next_addr, end_addr);
+			if (next_size) {
+				board_flash_read_start(next_addr, xfer_block[bufidx ^ 1], next_size);
+			}
 		}
 
 		if (cb != NULL) {
 			cb();
 		}
-		if (xfer_size) {
-			/*
-			 BS_DEBUG_U32(cur_addr);
-			 BS_DEBUG(" ");
-			 BS_DEBUG_U32_LN(xfer_size);
-			 cb();
-			 */
-			board_flash_read(cur_addr, xfer_block, xfer_size);
-			fpga_spi_write(xfer_block, xfer_size);
-			// FORCE_BS_DEBUG_BUF(xfer_block, xfer_size);
-			// sleep_ms(FLASH_SPI_XFER_BLOCKSIZE * 2);
-
-			cur_addr += xfer_size;
-			total_xfered += xfer_size;
+
 #ifdef BS_DEBUG_ENABLE
-				for (uint16_t i=0; i<xfer_size; i++) {
-					bytes_sum += xfer_block[i];
-				}
-			#endif
+		for (uint16_t i=0; i<xfer_size; i++) {
+			bytes_sum += xfer_block[bufidx][i];
+		}
+#endif
+		if (next_size && !compressed) {
+			board_flash_read_wait();
+		}
+		fpga_spi_write_wait();
 
-		} else {
-			BS_DEBUG_LN("Uuugh ");
-			cur_addr += 1;
+		cur_addr = next_addr;
+		total_xfered += xfer_size;
+		bs_prog_bytes_streamed = total_xfered;
+		xfer_size = next_size;
+		bufidx ^= 1;
+
+		if (bs_prog_abort_requested) {
+			BS_DEBUG_LN("Prog aborted");
+			break;
 		}
+	}
+	BS_DEBUG("Tot: "); BS_DEBUG_U32(total_xfered); BS_DEBUG_LN(" bytes"); BS_DEBUG("BS bytes sum: "); BS_DEBUG_U32_LN(bytes_sum);
+	return total_xfered;
+}
 
-	} BS_DEBUG("Tot: "); BS_DEBUG_U32(total_xfered); BS_DEBUG_LN(" bytes"); BS_DEBUG("BS bytes sum: "); BS_DEBUG_U32_LN(bytes_sum);
+/*
+ * cached image to FPGA, straight DMA, chunked only so the
+ * callback and abort still get a look in.
+ */
+static uint32_t bs_stream_from_ram(const uint8_t * src, uint32_t len, bs_prog_yield_cb cb) {
+	uint32_t total_xfered = 0;
+	BS_DEBUG("RAM prog "); BS_DEBUG_U32_LN(len);
+	while (total_xfered < len) {
+		uint32_t xfer_size = len - total_xfered;
+		if (xfer_size > BS_CACHE_XFER_BLOCKSIZE) {
+			xfer_size = BS_CACHE_XFER_BLOCKSIZE;
+		}
+		fpga_spi_write_start(&src[total_xfered], xfer_size);
+		if (cb != NULL) {
+			cb();
+		}
+		fpga_spi_write_wait();
+
+		total_xfered += xfer_size;
+		bs_prog_bytes_streamed = total_xfered;
+		if (bs_prog_abort_requested) {
+			BS_DEBUG_LN("Prog aborted");
+			break;
+		}
+	}
+	return total_xfered;
+}
+
+/*
+ * common end of programming: release the FPGA, or hold it
+ * in reset if we were aborted, and apply any auto-clock.
+ */
+static bool bs_program_finish(uint32_t total_xfered, uint32_t autoclockhz) {
+	fpga_spi_drain();
+	prog_stats_phase_done(ProgStatsPhaseStream);
 	fpga_exit_programming_mode();
+	prog_stats_phase_done(ProgStatsPhaseExit);
+	if (bs_prog_abort_requested || bs_prog_crc_mismatch) {
+		// partial or corrupt image, leave it held in reset
+		fpga_reset(true);
+		return false;
+	}
 	fpga_set_programmed(true);
-	uint32_t autoclockhz = bs_marker_state.settings.user_info.clock_hz;
 	DEBUG("FPGA Programmed.  Autoclock req: ");
 	DEBUG_U32_LN(autoclockhz);
 	if (autoclockhz) {
@@ -299,3 +427,128 @@ bool bs_program_fpga(bs_prog_yield_cb cb) {
 	return (total_xfered > 0);
 
 }
+
+static bool bs_program_from(const Bitstream_Marker_State * mstate, bs_prog_yield_cb cb) {
+
+	bs_prog_bytes_streamed = 0;
+	bs_prog_crc_mismatch = false;
+	if (bs_prog_abort_requested) {
+		// cancelled before we got going, leave the FPGA be
+		return false;
+	}
+
+	const Bitstream_MetaInfo * info = &mstate->settings.user_info;
+	bool check_crc = (info->flags & BITSTREAM_FLAG_CRC32) != 0;
+	BS_Cache_Key cache_key = {
+			.start_address = mstate->settings.start_address,
+			.size = mstate->settings.size,
+			.stream_size = bs_stream_size_of(mstate),
+			.flags = mstate->settings.user_info.flags,
+			// a fill racing a re-upload can still end up marked valid,
+			// same place and size, so tell them apart by content
+			.crc32 = check_crc ? info->crc32 : 0
+	};
+	const uint8_t * cached = bs_cache_lookup(&cache_key);
+
+	fpga_enter_programming_mode();
+	prog_stats_phase_done(ProgStatsPhaseEnter);
+	if (check_crc) {
+		// the sniffer checks the stream on its way to the FPGA
+		fpga_spi_crc32_start();
+	}
+
+	uint32_t total_xfered;
+	uint8_t * cache_fill = NULL;
+	if (cached != NULL) {
+		total_xfered = bs_stream_from_ram(cached, cache_key.stream_size, cb);
+	} else {
+		cache_fill = bs_cache_fill_begin(&cache_key);
+		board_flash_lock();
+		total_xfered = bs_stream_from_flash(mstate, cb, cache_fill, cache_key.stream_size);
+		board_flash_unlock();
+	}
+	if (check_crc) {
+		uint32_t crc = fpga_spi_crc32_end();
+		if (!bs_prog_abort_requested && crc != info->crc32) {
+			DEBUG("CRC mismatch, got ");
+			DEBUG_U32_LN(crc);
+			bs_prog_crc_mismatch = true;
+		}
+	}
+	if (cached == NULL) {
+		bs_cache_fill_end((!bs_prog_abort_requested) && (!bs_prog_crc_mismatch)
+				&& (total_xfered == cache_key.stream_size));
+	}
+	return bs_program_finish(total_xfered, info->clock_hz);
+}
+
+bool bs_program_fpga_slot(uint8_t slot, bs_prog_yield_cb cb) {
+	// private copy: the active marker state belongs to whoever
+	// is calling bs_check_for_marker() on the other core
+	static Bitstream_Marker_State slot_state;
+	bs_prog_bytes_streamed = 0;
+	if (!bs_load_marker(slot, &slot_state)) {
+		BS_DEBUG_LN("No bitstream in slot?");
+		return false;
+	}
+	return bs_program_from(&slot_state, cb);
+}
+
+bool bs_program_fpga_ram(const uint8_t * src, uint32_t len,
+		const Bitstream_MetaInfo * info, bs_prog_yield_cb cb) {
+	bs_prog_bytes_streamed = 0;
+	bs_prog_crc_mismatch = false;
+	if (src == NULL || !len || bs_prog_abort_requested) {
+		return false;
+	}
+
+	bool check_crc = (info->flags & BITSTREAM_FLAG_CRC32) != 0;
+	fpga_enter_programming_mode();
+	prog_stats_phase_done(ProgStatsPhaseEnter);
+	if (check_crc) {
+		fpga_spi_crc32_start();
+	}
+	uint32_t total_xfered = bs_stream_from_ram(src, len, cb);
+	if (check_crc) {
+		uint32_t crc = fpga_spi_crc32_end();
+		if (!bs_prog_abort_requested && crc != info->crc32) {
+			DEBUG("RAM CRC mismatch, got ");
+			DEBUG_U32_LN(crc);
+			bs_prog_crc_mismatch = true;
+		}
+	}
+	return bs_program_finish(total_xfered, info->clock_hz);
+}
+
+BS_VerifyResult bs_verify_slot(uint8_t slot, uint32_t * crc_out) {
+	Bitstream_Marker_State mstate;
+	if (!bs_load_marker(slot, &mstate)) {
+		return BSVerifyEmpty;
+	}
+	const Bitstream_MetaInfo * info = &mstate.settings.user_info;
+	const uint8_t * src = board_flash_xip(mstate.settings.start_address);
+
+	board_crc32_start();
+	if (info->flags & BITSTREAM_FLAG_COMPRESSED_RLE) {
+		// CRC is of what gets clocked in, so expand as we go
+		uint8_t expanded[FLASH_SPI_XFER_BLOCKSIZE];
+		BS_RLE_State rle;
+		uint16_t len;
+		bs_rle_init(&rle, src, mstate.settings.size);
+		while ((len = bs_rle_read(&rle, expanded, sizeof(expanded)))) {
+			board_crc32_update(expanded, len);
+		}
+	} else {
+		board_crc32_update(src, mstate.settings.size);
+	}
+	uint32_t crc = board_crc32_sniff_result();
+	board_crc32_sniff_stop();
+
+	if (crc_out != NULL) {
+		*crc_out = crc;
+	}
+	if (!(info->flags & BITSTREAM_FLAG_CRC32)) {
+		return BSVerifyNoCRC;
+	}
+	return (crc == info->crc32) ? BSVerifyOK : BSVerifyCorrupt;
+}
@@ -38,12 +38,19 @@ typedef  void (*bs_prog_yield_cb)(void);
  * passed within written UF2 bin files
  */
 typedef struct RIF_PACKED_STRUCT bitstream_metainfo_struct {
-	uint32_t bssize;
+	uint32_t bssize; // size of the bitstream, as sent to the FPGA
 	uint8_t namelen;
 	char name[BITSTREAM_NAME_MAXLEN];
 	uint32_t clock_hz;
+	uint8_t flags; // BITSTREAM_FLAG_*, 0 from older packagers
+	uint32_t crc32; // of the stream as clocked in, if BITSTREAM_FLAG_CRC32
 } Bitstream_MetaInfo;
 
+// Bitstream_MetaInfo flags
+#define BITSTREAM_FLAG_COMPRESSED_RLE	0x01 /* slot holds bs_rle encoded data */
+#define BITSTREAM_FLAG_VOLATILE			0x02 /* load to FPGA from RAM, never hits flash */
+#define BITSTREAM_FLAG_CRC32			0x04 /* crc32 field is valid */
+
 
 
 typedef struct bitstream_metainfo_payloadstruct {
@@ -77,9 +84,33 @@ uint32_t bs_check_for_marker(void);
 UF2_Block * bs_info(void);
 uint32_t bs_uf2_file_size(void);
 uint32_t bs_file_size(void);
-
-
-bool bs_program_fpga(bs_prog_yield_cb cb);
+// bytes actually clocked into the FPGA, differs from
+// bs_file_size() for compressed slots
+uint32_t bs_stream_size(void);
+bool bs_is_compressed(void);
+
+
+// program from a given slot, without touching the
+// active marker state.  Streaming holds the board flash
+// lock: cb must not lead to flash writes on the calling core
+bool bs_program_fpga_slot(uint8_t slot, bs_prog_yield_cb cb);
+// program an uncompressed image already sitting in RAM,
+// no slot or flash involved.  info supplies the auto-clock
+// and, with BITSTREAM_FLAG_CRC32, the CRC the stream must match
+bool bs_program_fpga_ram(const uint8_t * src, uint32_t len,
+		const Bitstream_MetaInfo * info, bs_prog_yield_cb cb);
+
+// bytes clocked out so far by the programming in progress
+uint32_t bs_program_progress(void);
+// last bs_program_fpga_*() failed because the stream didn't
+// match the slot's (or RAM image's) CRC32: FPGA left in reset, no point retrying
+bool bs_program_crc_failed(void);
+// ask a pending or in-progress bs_program_fpga_*() to bail out.
+// Sticks until bs_program_abort_clear(), so an abort that lands
+// before streaming starts isn't lost
+void bs_program_abort(void);
+void bs_program_abort_clear(void);
+bool bs_program_aborted(void);
 
 
 // pass it an array of Bitstream_Slot_Content[POSITION_SLOTS_ALLOWED]
@@ -93,6 +124,17 @@ void bs_write_marker(uint32_t num_blocks, uint32_t bitstream_size,
 void bs_write_marker_to_slot(uint8_t slot, uint32_t num_blocks, uint32_t bitstream_size,
 		uint32_t address_start, Bitstream_MetaInfo *info);
 
+typedef enum bsverifyresultenum {
+	BSVerifyEmpty = 0,
+	BSVerifyNoCRC,
+	BSVerifyOK,
+	BSVerifyCorrupt
+} BS_VerifyResult;
+
+// CRC32 of the slot's stream, against what the marker recorded.
+// Uses the DMA sniffer: only call while nothing is programming.
+BS_VerifyResult bs_verify_slot(uint8_t slot, uint32_t * crc_out);
+
 void bs_erase_slot(uint8_t slot);
 void bs_erase_all(void);
 
@@ -23,17 +23,75 @@
 #include "cdc_interface.h"
 
 const uint8_t *flash_read_access = (const uint8_t*) (XIP_BASE);
-/* note: each page is 4k */
-#define MAX_NUM_PAGES 192
-
-typedef struct page_state_struct {
-	int16_t index;
-	uint8_t erased;
-	uint16_t blocks_written;
-} PageState;
-static PageState pages_erased[MAX_NUM_PAGES] = { 0 };
+/*
+ * Per session erase/program tracking, indexed directly by
+ * page (4k flash sector): one bit per page saying we erased it,
+ * so it may be programmed without erasing again, and a mask
+ * of the 16 256-byte blocks programmed in it since.  UF2 payloads
+ * needn't be 256 bytes, or aligned, so a block may only have been
+ * partly programmed: those are in pages_blocks_partial too, and
+ * programming the rest of one isn't a double write.
+ */
+#define NUM_TRACKED_PAGES	(BOARD_FLASH_TRACKED_SIZE / FLASH_SECTOR_SIZE)
+#define PAGE_WRITE_BLOCKSIZE	256
+static uint32_t pages_erased[NUM_TRACKED_PAGES / 32] = { 0 };
+static uint16_t pages_blocks_written[NUM_TRACKED_PAGES] = { 0 };
+static uint16_t pages_blocks_partial[NUM_TRACKED_PAGES] = { 0 };
+/*
+ * Pages known to read all 0xff, because we erased them or
+ * found them blank, and haven't programmed them since.  Unlike
+ * the above, this outlives the session: it's what lets the
+ * upload after a wipe go straight to programming.
+ */
+static uint32_t pages_blank[NUM_TRACKED_PAGES / 32] = { 0 };
+
+/*
+ * Write-back buffer for UF2 payloads: gathered per sector and
+ * programmed in one go (one erase, one program) once the sector
+ * is complete, another one gets written to, or on flush, rather
+ * than going through flash_safe_execute() every 256 bytes.
+ * There are two: for board_flash_write_async(), a finished sector
+ * is handed over to sector_writeback and programmed from
+ * board_flash_task() while the next one fills up.
+ */
+typedef struct sectorbufferstruct {
+	uint8_t data[FLASH_SECTOR_SIZE];
+	uint32_t present[FLASH_SECTOR_SIZE / 32]; // a bit per byte
+	int32_t page; // -1 when empty
+	uint16_t blocks; // PAGE_WRITE_BLOCKSIZE blocks with anything present
+	uint32_t bytes; // of upload data, counted in size_uf2_written
+} SectorBuffer;
+static SectorBuffer sector_buffers[2] = { { .page = -1 }, { .page = -1 } };
+static SectorBuffer *sector_buffer = &sector_buffers[0];
+static SectorBuffer *sector_writeback = NULL;
+/*
+ * lifetime (since boot) and current upload session counters,
+ * always bumped together through FLASH_STAT_ADD()
+ */
+static BoardFlashStats flash_stats = { 0 };
+static BoardFlashStats flash_session_stats = { 0 };
+#define FLASH_STAT_ADD(field, v) \
+	do { flash_stats.field += (v); flash_session_stats.field += (v); } while (0)
+
+/*
+ * Background erases, done a step (one 64k block or 4k sector)
+ * at a time from board_flash_task(): the pre-erase of an upload's
+ * destination, so data blocks that follow only need programming,
+ * and slot wipes, which stop once upload data starts coming in.
+ */
+typedef struct erasejobstruct {
+	uint32_t start;
+	uint32_t next;
+	uint32_t end;
+} EraseJob;
+static EraseJob preerase_job = { 0 };
+static EraseJob wipe_job = { 0 };
+
 static uint32_t size_uf2_written = 0;
 static uint32_t uf2_start_address = 0;
+static int flash_read_dma_chan = -1;
+static int crc_dma_chan = -1;
+static mutex_t flash_access_mutex;
 
 //define BRD_DEBUG_ENABLE
 #ifdef BRD_DEBUG_ENABLE
@@ -78,118 +136,115 @@ void board_gpio_init(void) {
 // Initialize flash for DFU
 void board_flash_init(void) {
 	board_size_written_clear();
-
-}
-static uint8_t pages_erased_cache_index_for(uint16_t page) {
-
-	for (uint8_t i = 0; i < MAX_NUM_PAGES; i++) {
-		if (pages_erased[i].index < 0) {
-			// shouldn't happen
-			return MAX_NUM_PAGES - 1;
-		}
-		if (pages_erased[i].index == page) {
-			return i;
-		}
+	if (flash_read_dma_chan < 0) {
+		flash_read_dma_chan = dma_claim_unused_channel(true);
+		crc_dma_chan = dma_claim_unused_channel(true);
+		mutex_init(&flash_access_mutex);
 	}
-	// shouldn't happen
-	return MAX_NUM_PAGES - 1;
-}
-static bool page_was_erased(uint16_t page) {
 
-	for (uint8_t i = 0; i < MAX_NUM_PAGES; i++) {
-		if (pages_erased[i].index < 0) {
-			return 0;
-		}
-		if (pages_erased[i].index == page) {
-			return pages_erased[i].erased;
-		}
-	}
-	return 0;
 }
-
 static uint16_t page_for(uint32_t addr) {
 	uint16_t pid = (uint16_t) (addr >> 12);
 	return pid;
 }
-static uint16_t page_blockmask_for(uint32_t req_addr, uint32_t len) {
-	uint16_t pid = page_for(req_addr);
-
-	uint32_t page_start_address = (((uint32_t)pid) << 12);
-
-	uint32_t addr = req_addr;
-	uint16_t write_block_size = 256;
-	uint16_t mask = 0;
-	while (addr < (req_addr + len)) {
-
-		mask |= 1 << (uint8_t)((addr - page_start_address)/write_block_size);
 
-		addr += write_block_size;
+static bool page_is_tracked(uint16_t page) {
+	return page < NUM_TRACKED_PAGES;
+}
 
+static bool page_was_erased(uint16_t page) {
+	if (!page_is_tracked(page)) {
+		// unknown, so erase every time
+		return false;
 	}
-	/*
-	BRD_DEBUG("BMsk: ");
-	BRD_DEBUG_U32(addr);
-	BRD_DEBUG("/");
-	BRD_DEBUG_U32(page_start_address);
-	BRD_DEBUG(", ");
-	BRD_DEBUG_U32(len);
-	BRD_DEBUG(": ");
-	BRD_DEBUG_U16_LN(mask);
-	*/
-	return mask;
+	return (pages_erased[page / 32] & (1UL << (page % 32))) != 0;
+}
 
+// blocks of the page covered by [req_addr, req_addr + len)
+static uint16_t page_blockmask_for(uint32_t req_addr, uint32_t len) {
+	uint32_t page_offset = req_addr & (FLASH_SECTOR_SIZE - 1);
+	uint32_t page_end = page_offset + len;
+	if (!len) {
+		return 0;
+	}
+	if (page_end > FLASH_SECTOR_SIZE) {
+		page_end = FLASH_SECTOR_SIZE;
+	}
+	uint8_t first = page_offset / PAGE_WRITE_BLOCKSIZE;
+	uint8_t last = (page_end - 1) / PAGE_WRITE_BLOCKSIZE;
+	return (uint16_t) (((1UL << (last + 1)) - 1) & ~((1UL << first) - 1));
 }
 
 static bool has_been_programmed(uint32_t req_addr, uint32_t len) {
 	uint16_t page = page_for(req_addr);
-	uint16_t blocks_to_write = page_blockmask_for(req_addr, len);
+	if (!page_is_tracked(page)) {
+		return false;
+	}
+	uint16_t full = pages_blocks_written[page] & ~pages_blocks_partial[page];
+	return (full & page_blockmask_for(req_addr, len)) != 0;
+}
 
-	uint8_t idx = pages_erased_cache_index_for(page);
-	if (pages_erased[idx].blocks_written & blocks_to_write) {
-		return true;
+static bool page_known_blank(uint16_t page) {
+	if (!page_is_tracked(page)) {
+		return false;
 	}
-	return false;
+	return (pages_blank[page / 32] & (1UL << (page % 32))) != 0;
 }
 
-static void register_programmed(uint32_t req_addr, uint32_t len) {
-	uint16_t page = page_for(req_addr);
-	uint16_t blocks_written = page_blockmask_for(req_addr, len);
+static void mark_known_blank(uint16_t page, bool set_to) {
+	if (!page_is_tracked(page)) {
+		return;
+	}
+	if (set_to) {
+		pages_blank[page / 32] |= (1UL << (page % 32));
+	} else {
+		pages_blank[page / 32] &= ~(1UL << (page % 32));
+	}
+}
 
-	uint8_t idx = pages_erased_cache_index_for(page);
-	pages_erased[idx].blocks_written |= blocks_written;
+// blocks now hold upload data, those in partial only some of theirs
+static void register_blocks(uint16_t page, uint16_t blocks, uint16_t partial) {
+	if (!page_is_tracked(page)) {
+		return;
+	}
+	uint16_t full_before = pages_blocks_written[page] & ~pages_blocks_partial[page];
+	pages_blocks_written[page] |= blocks;
+	pages_blocks_partial[page] = (pages_blocks_partial[page] & ~blocks)
+			| (blocks & partial & ~full_before);
 	BRD_DEBUG("Pg ");
 	BRD_DEBUG_U16(page);
 	BRD_DEBUG(" wrt ");
-	BRD_DEBUG_U16_LN(pages_erased[idx].blocks_written);
+	BRD_DEBUG_U16_LN(pages_blocks_written[page]);
 
 
-	if (pages_erased[idx].blocks_written == 0xffff) {
+	if ((pages_blocks_written[page] & ~pages_blocks_partial[page]) == 0xffff) {
 		// we *had* erased, but now everything's been written over
 		// this is no longer to be considered erased.
-		pages_erased[idx].erased = 0;
+		pages_erased[page / 32] &= ~(1UL << (page % 32));
 		BRD_DEBUG("All filled!");
 	}
 
 }
 
+static void register_programmed(uint32_t req_addr, uint32_t len, uint16_t partial) {
+	uint16_t page = page_for(req_addr);
+	for (uint16_t p = page; p <= page_for(req_addr + len - 1); p++) {
+		mark_known_blank(p, false);
+	}
+	register_blocks(page, page_blockmask_for(req_addr, len), partial);
+}
+
 uint32_t board_first_written_address(void) {
 	return uf2_start_address;
 }
 int16_t board_first_written_page(void) {
-	int16_t first_page = 0x7fff;
-	bool found_pages = false;
-	for (uint8_t i = 0; i < MAX_NUM_PAGES; i++) {
-		if (pages_erased[i].index >= 0) {
-			if (pages_erased[i].index < first_page) {
-				first_page = pages_erased[i].index;
-				found_pages = true;
-			}
+	// pages stop counting as erased once filled, but
+	// keep their written mask until cleared
+	for (uint16_t page = 0; page < NUM_TRACKED_PAGES; page++) {
+		if (page_was_erased(page) || pages_blocks_written[page]) {
+			return page;
 		}
 	}
-
-	if (found_pages) {
-		return first_page;
-	}
 	return -1;
 }
 
@@ -199,18 +254,14 @@ uint32_t page_address_from_index(uint16_t page) {
 }
 
 static void mark_as_erased(uint16_t page) {
-
-	for (uint8_t i = 0; i < MAX_NUM_PAGES; i++) {
-		if (pages_erased[i].index < 0) {
-			pages_erased[i].index = page;
-			pages_erased[i].erased = 1;
-			pages_erased[i].blocks_written = 0;
-			BRD_DEBUG("Mark page 0x"); BRD_DEBUG_U16(page); BRD_DEBUG(" erased @ "); BRD_DEBUG_U8_LN(i);
-			CDCWRITEFLUSH();
-
-			return;
-		}
+	if (!page_is_tracked(page)) {
+		return;
 	}
+	pages_erased[page / 32] |= (1UL << (page % 32));
+	pages_blocks_written[page] = 0;
+	pages_blocks_partial[page] = 0;
+	mark_known_blank(page, true);
+	BRD_DEBUG("Mark page 0x"); BRD_DEBUG_U16_LN(page);
 }
 
 // Get size of flash
@@ -227,6 +278,60 @@ void board_flash_read(uint32_t addr, void *buffer, uint32_t len) {
 
 }
 
+const uint8_t * board_flash_xip(uint32_t addr) {
+	return &(flash_read_access[addr]);
+}
+
+void board_flash_read_start(uint32_t addr, void *buffer, uint32_t len) {
+	dma_channel_config c = dma_channel_get_default_config(flash_read_dma_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, true);
+	dma_channel_configure(flash_read_dma_chan, &c, buffer,
+			&(flash_read_access[addr]), len, true);
+}
+
+void board_flash_read_wait(void) {
+	dma_channel_wait_for_finish_blocking(flash_read_dma_chan);
+}
+
+/*
+ * CRC32 through the DMA sniffer: reflected data in, reversed and
+ * inverted out, seeded with all ones, which is what zlib's
+ * crc32() (and so python's) computes.
+ */
+#define CRC32_SNIFF_CALC_REFLECTED	0x1
+
+void board_crc32_sniff_start(uint dma_chan) {
+	dma_sniffer_enable(dma_chan, CRC32_SNIFF_CALC_REFLECTED, false);
+	dma_sniffer_set_output_reverse_enabled(true);
+	dma_sniffer_set_output_invert_enabled(true);
+	dma_sniffer_set_data_accumulator(0xffffffff);
+}
+
+uint32_t board_crc32_sniff_result(void) {
+	return dma_sniffer_get_data_accumulator();
+}
+
+void board_crc32_sniff_stop(void) {
+	dma_sniffer_disable();
+}
+
+void board_crc32_start(void) {
+	board_crc32_sniff_start(crc_dma_chan);
+}
+
+void board_crc32_update(const void *data, uint32_t len) {
+	static uint32_t crc_sink;
+	dma_channel_config c = dma_channel_get_default_config(crc_dma_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_sniff_enable(&c, true);
+	dma_channel_configure(crc_dma_chan, &c, &crc_sink, data, len, true);
+	dma_channel_wait_for_finish_blocking(crc_dma_chan);
+}
+
 static void call_flash_page_erase(void *param) {
 	uint16_t *page = (uint16_t*) param;
 
@@ -235,6 +340,14 @@ static void call_flash_page_erase(void *param) {
 	flash_range_erase(offset, FLASH_SECTOR_SIZE);
 }
 
+static void call_flash_range_erase(void *param) {
+	uint32_t offset = ((uint32_t*) param)[0];
+	uint32_t len = ((uint32_t*) param)[1];
+	BRD_DEBUG("Erasing range @"); BRD_DEBUG_U32_LN(offset);
+	// the boot ROM uses 64k block erases where it can
+	flash_range_erase(offset, len);
+}
+
 static void call_flash_range_program(void *param) {
 	uint32_t offset = ((uintptr_t*) param)[0];
 	const uint8_t *data = (const uint8_t*) ((uintptr_t*) param)[1];
@@ -247,30 +360,61 @@ static void call_flash_range_program(void *param) {
 	flash_range_program(offset, data, *size);
 }
 
-bool board_flash_write(uint32_t addr, void const *data, uint32_t len) {
-	(void) data;
-	(void) len;
+/*
+ * flash_safe_execute(), timed: that's how long XIP (and so
+ * everything, USB included) was stalled on both cores
+ */
+static int flash_execute_timed(void (*func)(void*), void *param) {
+	uint64_t tstart = time_us_64();
+	int rc = flash_safe_execute(func, param, UINT32_MAX);
+	uint32_t elapsed_us = (uint32_t) (time_us_64() - tstart);
+	FLASH_STAT_ADD(exec_us_total, elapsed_us);
+	if (elapsed_us > flash_stats.exec_us_max) {
+		flash_stats.exec_us_max = elapsed_us;
+	}
+	if (elapsed_us > flash_session_stats.exec_us_max) {
+		flash_session_stats.exec_us_max = elapsed_us;
+	}
+	return rc;
+}
+
+void board_flash_lock(void) {
+	mutex_enter_blocking(&flash_access_mutex);
+}
+
+void board_flash_unlock(void) {
+	mutex_exit(&flash_access_mutex);
+}
+
+/*
+ * For board_flash_task(): core 1 holds the lock for the whole of a
+ * load out of flash, and the main loop mustn't sit through that with
+ * USB unserviced.  Whatever needed it is left for the next pass.
+ */
+static bool board_flash_try_lock(void) {
+	return mutex_try_enter(&flash_access_mutex, NULL);
+}
+
+static bool flash_erase_page_unlocked(uint16_t page_index) {
+	int rc = flash_execute_timed(call_flash_page_erase, (void*) (&page_index));
+	if (rc != PICO_OK) {
+		BRD_DEBUG_LN("ERR ERASE");
+		CDCWRITESTRING("\r\nFlash Page errase error!\r\n");
+		return false;
+	}
+	FLASH_STAT_ADD(erases, 1);
+	mark_as_erased(page_index);
+	return true;
+}
+
+static bool flash_program_unlocked(uint32_t addr, void const *data, uint32_t len,
+		uint16_t partial) {
 	// BRD_DEBUG("flash write: ");
 	// BRD_DEBUG_U32_LN(addr);
 	uint32_t *lenptr = &len;
-	int rc;
-	uint16_t page_index = page_for(addr);
-	if (!page_was_erased(page_index)) {
-		rc = flash_safe_execute(call_flash_page_erase, (void*) (&page_index),
-				UINT32_MAX);
-		if (rc == PICO_OK) {
-			mark_as_erased(page_index);
-		} else {
-			BRD_DEBUG_LN("ERR ERASE");
-			CDCWRITESTRING("\r\nFlash Page errase error!\r\n");
-			return 0;
-		}
-	}
-	if (addr < uf2_start_address) {
-		uf2_start_address = addr;
-	}
 
 	if (has_been_programmed(addr, len)) {
+		FLASH_STAT_ADD(double_writes, 1);
 		CDCWRITESTRING("\r\nWRN: DOUBLE write @ 0x");
 		cdc_write_u32_ln(addr);
 
@@ -283,30 +427,464 @@ bool board_flash_write(uint32_t addr, void const *data, uint32_t len) {
 
 
 	uintptr_t params[] = { addr, (uintptr_t) data, (uintptr_t) lenptr };
-	rc = flash_safe_execute(call_flash_range_program, params, UINT32_MAX);
-	if (rc == PICO_OK) {
-		// BRD_DEBUG_LN("Wrote!");
-		register_programmed(addr, len);
-		size_uf2_written += len;
-	} else {
+	int rc = flash_execute_timed(call_flash_range_program, params);
+	if (rc != PICO_OK) {
 		CDCWRITESTRING("\r\nWrite fail!! @0x");
 		cdc_write_u32_ln(addr);
+		return false;
 	}
+	// BRD_DEBUG_LN("Wrote!");
+	FLASH_STAT_ADD(programs, 1);
+	FLASH_STAT_ADD(bytes_programmed, len);
+	register_programmed(addr, len, partial);
+	return true;
 
-	return 1;
+}
 
+// programming only clears bits: anything else needs an erase first
+static bool flash_block_programmable(const uint8_t *current, const uint8_t *block) {
+	const uint32_t *cur = (const uint32_t*) current;
+	const uint32_t *w = (const uint32_t*) block;
+	for (uint16_t i = 0; i < (PAGE_WRITE_BLOCKSIZE / sizeof(uint32_t)); i++) {
+		if ((cur[i] & w[i]) != w[i]) {
+			return false;
+		}
+	}
+	return true;
 }
 
-uint32_t board_size_written(void) {
-	return size_uf2_written;
+static void present_mark(SectorBuffer *sb, uint32_t offset, uint32_t len) {
+	while (len) {
+		uint32_t bit = offset % 32;
+		uint32_t n = 32 - bit;
+		if (n > len) {
+			n = len;
+		}
+		sb->present[offset / 32] |= (n == 32) ? 0xffffffff
+				: (((1UL << n) - 1) << bit);
+		offset += n;
+		len -= n;
+	}
 }
 
-void board_flash_pages_erased_clear(void) {
+// blocks with something, but not everything, present
+static uint16_t sector_buffer_partial(const SectorBuffer *sb) {
+	uint16_t partial = 0;
+	uint8_t words_per_block = PAGE_WRITE_BLOCKSIZE / 32;
+	for (uint8_t blk = 0; blk < (FLASH_SECTOR_SIZE / PAGE_WRITE_BLOCKSIZE); blk++) {
+		if (!(sb->blocks & (1UL << blk))) {
+			continue;
+		}
+		for (uint8_t i = 0; i < words_per_block; i++) {
+			if (sb->present[(blk * words_per_block) + i] != 0xffffffff) {
+				partial |= (1UL << blk);
+				break;
+			}
+		}
+	}
+	return partial;
+}
 
-	for (uint8_t i = 0; i < MAX_NUM_PAGES; i++) {
-		pages_erased[i].index = -1;
+/*
+ * Gaps in blocks that already got some data this session: what's
+ * in flash there is that data or still blank (a partial block is
+ * only ever programmed over blank bytes), so it's copied in to be
+ * kept.  Gaps elsewhere stay 0xff.
+ */
+static void sector_buffer_fill_holes(SectorBuffer *sb, const uint8_t *current,
+		uint16_t partial) {
+	uint8_t words_per_block = PAGE_WRITE_BLOCKSIZE / 32;
+	for (uint8_t blk = 0; partial; blk++, partial >>= 1) {
+		if (!(partial & 1)) {
+			continue;
+		}
+		for (uint8_t i = 0; i < words_per_block; i++) {
+			uint32_t w = (blk * words_per_block) + i;
+			uint32_t missing = ~sb->present[w];
+			while (missing) {
+				uint8_t bit = (uint8_t) __builtin_ctz(missing);
+				sb->data[(w * 32) + bit] = current[(w * 32) + bit];
+				missing &= missing - 1;
+			}
+		}
 	}
+}
 
+/*
+ * For a page we haven't erased this session, look at what's
+ * already there before erasing: blocks that are identical get
+ * skipped, blank ones can be programmed as is.  Only if some
+ * block has other contents does the page get erased, and then
+ * anything we kept or programmed in it earlier is put back.
+ * Returns the blocks that still need programming, with partial
+ * updated to those of them only partly ours.
+ */
+static uint16_t sector_buffer_prepare_unlocked(SectorBuffer *sb, uint16_t *partial,
+		bool *ok) {
+	uint16_t page = (uint16_t) sb->page;
+	uint32_t page_addr = page_address_from_index(page);
+	const uint8_t *current = board_flash_xip(page_addr);
+	uint16_t blocks = sb->blocks;
+	uint16_t todo = 0;
+	bool need_erase = false;
+
+	if (page_was_erased(page)) {
+		// the gaps are 0xff, which programs as a no-op
+		return blocks;
+	}
+	if (page_known_blank(page)) {
+		// blanked earlier (a wipe, say): no need to look
+		FLASH_STAT_ADD(erases_skipped, 1);
+		return blocks;
+	}
+	if (page_is_tracked(page)) {
+		sector_buffer_fill_holes(sb, current, *partial & pages_blocks_written[page]);
+	}
+
+	for (uint8_t blk = 0; blk < (FLASH_SECTOR_SIZE / PAGE_WRITE_BLOCKSIZE); blk++) {
+		uint32_t offset = blk * PAGE_WRITE_BLOCKSIZE;
+		if (!(blocks & (1UL << blk))) {
+			continue;
+		}
+		if (memcmp(&current[offset], &sb->data[offset], PAGE_WRITE_BLOCKSIZE) == 0) {
+			continue;
+		}
+		todo |= (1UL << blk);
+		if (!flash_block_programmable(&current[offset], &sb->data[offset])) {
+			need_erase = true;
+		}
+	}
+
+	if (!need_erase) {
+		FLASH_STAT_ADD(erases_skipped, 1);
+		FLASH_STAT_ADD(blocks_identical, __builtin_popcount(blocks & ~todo));
+		register_blocks(page, blocks & ~todo, *partial);
+		return todo;
+	}
+
+	uint16_t keep = 0;
+	if (page_is_tracked(page)) {
+		keep = pages_blocks_written[page] & ~blocks;
+		*partial |= keep & pages_blocks_partial[page];
+	}
+	for (uint8_t blk = 0; blk < (FLASH_SECTOR_SIZE / PAGE_WRITE_BLOCKSIZE); blk++) {
+		if (keep & (1UL << blk)) {
+			uint32_t offset = blk * PAGE_WRITE_BLOCKSIZE;
+			memcpy(&sb->data[offset], &current[offset], PAGE_WRITE_BLOCKSIZE);
+		}
+	}
+	if (!flash_erase_page_unlocked(page)) {
+		*ok = false;
+		return 0;
+	}
+	return blocks | keep;
+}
+
+/*
+ * programs each run of contiguous blocks in the sector buffer,
+ * which for a sequential upload is the whole sector at once
+ */
+static bool sector_buffer_drain_unlocked(SectorBuffer *sb) {
+	if (sb->page < 0) {
+		return true;
+	}
+	uint32_t page_addr = page_address_from_index((uint16_t) sb->page);
+	uint8_t num_blocks = FLASH_SECTOR_SIZE / PAGE_WRITE_BLOCKSIZE;
+	bool ok = true;
+	uint16_t partial = sector_buffer_partial(sb);
+	uint16_t todo = sector_buffer_prepare_unlocked(sb, &partial, &ok);
+	uint8_t blk = 0;
+	while (blk < num_blocks) {
+		if (!(todo & (1UL << blk))) {
+			blk++;
+			continue;
+		}
+		uint8_t run_end = blk;
+		while (run_end < num_blocks && (todo & (1UL << run_end))) {
+			run_end++;
+		}
+		uint32_t offset = blk * PAGE_WRITE_BLOCKSIZE;
+		if (!flash_program_unlocked(page_addr + offset, &sb->data[offset],
+				(run_end - blk) * PAGE_WRITE_BLOCKSIZE, partial)) {
+			ok = false;
+		}
+		blk = run_end;
+	}
+	if (!ok) {
+		// was counted when buffered
+		size_uf2_written -= sb->bytes;
+	}
+	sb->page = -1;
+	sb->blocks = 0;
+	sb->bytes = 0;
+	memset(sb->present, 0, sizeof(sb->present));
+	return ok;
+}
+
+static bool sector_buffer_drain(SectorBuffer *sb) {
+	// the programming worker may be DMA'ing out of XIP on
+	// the other core, wait for it to get out of the way
+	board_flash_lock();
+	bool rv = sector_buffer_drain_unlocked(sb);
+	board_flash_unlock();
+	return rv;
+}
+
+static bool sector_writeback_drain(void) {
+	if (!sector_writeback) {
+		return true;
+	}
+	bool rv = sector_buffer_drain(sector_writeback);
+	sector_writeback = NULL;
+	return rv;
+}
+
+static bool sector_buffers_drain(void) {
+	// older one first, it may share pages with what follows
+	bool rv = sector_writeback_drain();
+	return sector_buffer_drain(sector_buffer) && rv;
+}
+
+/*
+ * Hand the sector being filled over to board_flash_task() and
+ * start filling the other one.  Only when nothing is waiting.
+ */
+static void sector_buffer_retire(void) {
+	sector_writeback = sector_buffer;
+	sector_buffer = (sector_buffer == &sector_buffers[0]) ?
+			&sector_buffers[1] : &sector_buffers[0];
+}
+
+static bool sector_buffer_fill(uint32_t addr, void const *data, uint32_t len,
+		bool deferred, bool upload) {
+	const uint8_t *src = (const uint8_t*) data;
+	bool rv = true;
+	if (upload && addr < uf2_start_address) {
+		uf2_start_address = addr;
+	}
+	if (upload) {
+		// that upload's own pre-erase takes it from here
+		wipe_job.end = wipe_job.next;
+	}
+	while (len) {
+		uint16_t page = page_for(addr);
+		uint32_t offset = addr & (FLASH_SECTOR_SIZE - 1);
+		uint32_t chunk = FLASH_SECTOR_SIZE - offset;
+		if (chunk > len) {
+			chunk = len;
+		}
+		if (sector_buffer->page != page) {
+			if (deferred && sector_buffer->page >= 0) {
+				sector_buffer_retire();
+			} else if (!deferred) {
+				rv = sector_buffers_drain() && rv;
+			}
+			memset(sector_buffer->data, 0xff, sizeof(sector_buffer->data));
+			sector_buffer->page = page;
+		}
+		memcpy(&sector_buffer->data[offset], src, chunk);
+		present_mark(sector_buffer, offset, chunk);
+		sector_buffer->blocks |= page_blockmask_for(addr, chunk);
+		if (upload) {
+			sector_buffer->bytes += chunk;
+			size_uf2_written += chunk;
+		}
+		if (sector_buffer->blocks == 0xffff && !sector_buffer_partial(sector_buffer)) {
+			if (!deferred) {
+				rv = sector_buffer_drain(sector_buffer) && rv;
+			} else if (!sector_writeback) {
+				sector_buffer_retire();
+			}
+		}
+		addr += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+	return rv;
+}
+
+bool board_flash_write(uint32_t addr, void const *data, uint32_t len) {
+	// same path as buffered writes, just drained right away. Config
+	// and markers come through here, which isn't upload data: leave
+	// board_size_written()/board_first_written_address() alone
+	bool rv = sector_buffer_fill(addr, data, len, false, false);
+	return sector_buffers_drain() && rv;
+}
+
+bool board_flash_write_buffered(uint32_t addr, void const *data, uint32_t len) {
+	return sector_buffer_fill(addr, data, len, false, true);
+}
+
+bool board_flash_write_async(uint32_t addr, void const *data, uint32_t len) {
+	uint16_t first = page_for(addr);
+	uint16_t last = page_for(addr + len - 1);
+	// sectors the write moves on to, each needs the current one retired
+	uint8_t retires = (last != first) ? 1 : 0;
+	if (sector_buffer->page >= 0 && sector_buffer->page != first) {
+		retires++;
+	}
+	if (!retires || (retires == 1 && !sector_writeback)) {
+		sector_buffer_fill(addr, data, len, true, true);
+		return true;
+	}
+	if (!sector_writeback && sector_buffer->page >= 0) {
+		// get the current sector going, the rest once it's done
+		sector_buffer_retire();
+	}
+	return false;
+}
+
+bool board_flash_write_pending(void) {
+	return sector_writeback != NULL;
+}
+
+static bool page_is_touched(uint16_t page) {
+	if (!page_is_tracked(page)) {
+		return true;
+	}
+	return page_was_erased(page) || pages_blocks_written[page]
+			|| (sector_buffer->page == page)
+			|| (sector_writeback && sector_writeback->page == page);
+}
+
+static bool flash_range_is_blank(uint32_t addr, uint32_t len) {
+	const uint32_t *w = (const uint32_t*) board_flash_xip(addr);
+	for (uint32_t i = 0; i < (len / sizeof(uint32_t)); i++) {
+		if (w[i] != 0xffffffff) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool flash_range_known_blank(uint16_t first_page, uint16_t num_pages) {
+	for (uint16_t i = 0; i < num_pages; i++) {
+		if (!page_known_blank(first_page + i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void erase_job_set(EraseJob *job, uint32_t addr, uint32_t len) {
+	job->start = addr & ~(FLASH_SECTOR_SIZE - 1);
+	job->next = job->start;
+	job->end = (addr + len + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+	BRD_DEBUG("Erase job "); BRD_DEBUG_U32(job->next);
+	BRD_DEBUG("-"); BRD_DEBUG_U32_LN(job->end);
+}
+
+static bool erase_job_pending(const EraseJob *job) {
+	return job->next < job->end;
+}
+
+void board_flash_preerase(uint32_t addr, uint32_t len) {
+	erase_job_set(&preerase_job, addr, len);
+}
+
+bool board_flash_preerase_pending(void) {
+	return erase_job_pending(&preerase_job);
+}
+
+void board_flash_wipe(uint32_t addr, uint32_t len) {
+	erase_job_set(&wipe_job, addr, len);
+}
+
+bool board_flash_wipe_progress(uint32_t *done, uint32_t *total) {
+	*done = wipe_job.next - wipe_job.start;
+	*total = wipe_job.end - wipe_job.start;
+	return erase_job_pending(&wipe_job);
+}
+
+static void erase_job_step(EraseJob *job) {
+	uint32_t addr = job->next;
+	uint32_t len = FLASH_SECTOR_SIZE;
+	uint16_t first_page = page_for(addr);
+	uint16_t num_pages = FLASH_BLOCK_SIZE / FLASH_SECTOR_SIZE;
+
+	if (!(addr & (FLASH_BLOCK_SIZE - 1))
+			&& (job->end - addr) >= FLASH_BLOCK_SIZE) {
+		len = FLASH_BLOCK_SIZE;
+		// only if data hasn't started landing in there already
+		for (uint16_t i = 0; i < num_pages; i++) {
+			if (page_is_touched(first_page + i)) {
+				len = FLASH_SECTOR_SIZE;
+				break;
+			}
+		}
+	}
+	job->next = addr + len;
+	num_pages = len / FLASH_SECTOR_SIZE;
+	if (len == FLASH_SECTOR_SIZE && page_is_touched(first_page)) {
+		return;
+	}
+
+	if (!flash_range_known_blank(first_page, num_pages)
+			&& !flash_range_is_blank(addr, len)) {
+		uint32_t params[] = { addr, len };
+		if (!board_flash_try_lock()) {
+			// same step again next time round
+			job->next = addr;
+			return;
+		}
+		int rc = flash_execute_timed(call_flash_range_erase, params);
+		board_flash_unlock();
+		if (rc != PICO_OK) {
+			// leave it to the writes, which erase as needed
+			return;
+		}
+		if (len == FLASH_BLOCK_SIZE) {
+			FLASH_STAT_ADD(block_erases, 1);
+		} else {
+			FLASH_STAT_ADD(erases, 1);
+		}
+	}
+	// erased or already blank, either way it's ready to program
+	for (uint16_t i = 0; i < num_pages; i++) {
+		mark_as_erased(first_page + i);
+	}
+}
+
+void board_flash_task(void) {
+	// one erase/program per call: written-back sectors first, since
+	// the upload is waiting on them, then any pre-erasing, then wipes
+	if (sector_writeback) {
+		if (board_flash_try_lock()) {
+			sector_buffer_drain_unlocked(sector_writeback);
+			sector_writeback = NULL;
+			board_flash_unlock();
+		}
+	} else if (erase_job_pending(&preerase_job)) {
+		erase_job_step(&preerase_job);
+	} else if (erase_job_pending(&wipe_job)) {
+		erase_job_step(&wipe_job);
+	}
+}
+
+const BoardFlashStats* board_flash_stats(void) {
+	return &flash_stats;
+}
+
+const BoardFlashStats* board_flash_session_stats(void) {
+	return &flash_session_stats;
+}
+
+void board_flash_session_start(void) {
+	memset(&flash_session_stats, 0, sizeof(flash_session_stats));
+	flash_stats.sessions++;
+	flash_session_stats.sessions = 1;
+}
+
+uint32_t board_size_written(void) {
+	return size_uf2_written;
+}
+
+void board_flash_pages_erased_clear(void) {
+	// the pre-erase relies on this tracking to stay off written pages
+	preerase_job.next = preerase_job.end = 0;
+	memset(pages_erased, 0, sizeof(pages_erased));
+	memset(pages_blocks_written, 0, sizeof(pages_blocks_written));
+	memset(pages_blocks_partial, 0, sizeof(pages_blocks_partial));
 }
 void board_size_written_clear(void) {
 	size_uf2_written = 0;
@@ -322,6 +900,6 @@ void board_size_written_clear(void) {
 void board_flash_flush(void) {
 
 	BRD_DEBUG_LN("FLUSH CALLED!!!! WE DONE");
+	sector_buffers_drain();
 	board_flash_pages_erased_clear();
-	sleep_ms(250);
 }
@@ -50,9 +50,95 @@ uint32_t board_first_written_address(void);
 // Read from flash
 void board_flash_read (uint32_t addr, void* buffer, uint32_t len);
 
-// Write to flash, len is uf2's payload size (often 256 bytes)
+// direct, memory-mapped, access to flash contents
+const uint8_t * board_flash_xip(uint32_t addr);
+
+// DMA read from flash: _start returns immediately, buffer is
+// only valid once board_flash_read_wait() has returned
+void board_flash_read_start(uint32_t addr, void* buffer, uint32_t len);
+void board_flash_read_wait(void);
+
+// CRC32 (as zlib's crc32()) of everything a DMA channel moves,
+// configured with sniff enabled.  There's a single sniffer, so
+// one user at a time: the programming worker while streaming,
+// core 0 otherwise.
+void board_crc32_sniff_start(uint dma_chan);
+uint32_t board_crc32_sniff_result(void);
+void board_crc32_sniff_stop(void);
+// the same, for memory (XIP included) run through a spare
+// channel: start, update as often as needed, read the result
+void board_crc32_start(void);
+void board_crc32_update(const void * data, uint32_t len);
+
+// held around any DMA streaming out of XIP, so writes from
+// the other core can't erase/program underneath it.
+// board_flash_write() takes it itself.
+void board_flash_lock(void);
+void board_flash_unlock(void);
+
+// Write to flash right away, for config/markers: doesn't count
+// as upload data in board_size_written()
 bool board_flash_write(uint32_t addr, void const* data, uint32_t len);
 
+// Upload data: gathered per sector and only programmed once the
+// sector is complete, another sector is written, on the next
+// board_flash_write() or on board_flash_flush().  Counts towards
+// board_size_written() as soon as it's accepted.
+bool board_flash_write_buffered(uint32_t addr, void const* data, uint32_t len);
+
+// Same again, but never erases/programs itself: a finished
+// sector is left to board_flash_task().  Returns false, having
+// taken nothing, while that's still pending and the write needs
+// a new sector; call again later with the same arguments.
+bool board_flash_write_async(uint32_t addr, void const* data, uint32_t len);
+bool board_flash_write_pending(void);
+
+/*
+ * Sectors are compared against what's in flash before being
+ * erased: identical blocks are skipped and blank sectors are
+ * programmed without an erase.  Counters since boot, and since
+ * the start of the last upload.
+ */
+typedef struct boardflashstatsstruct {
+	uint32_t erases;
+	uint32_t block_erases; // 64k, by the pre-erase
+	uint32_t erases_skipped; // sectors that were blank or identical
+	uint32_t blocks_identical; // 256 byte blocks not programmed
+	uint32_t programs; // flash_range_program() calls
+	uint32_t bytes_programmed;
+	uint32_t double_writes; // programmed twice without an erase
+	uint32_t exec_us_total; // in flash_safe_execute(), XIP stalled
+	uint32_t exec_us_max;
+	uint32_t sessions; // uploads
+} BoardFlashStats;
+
+const BoardFlashStats * board_flash_stats(void);
+const BoardFlashStats * board_flash_session_stats(void);
+
+// resets the session counters, when an upload starts
+void board_flash_session_start(void);
+
+/*
+ * Erase [addr, addr + len) ahead of an upload, a 64k block (where
+ * aligned) or 4k sector per board_flash_task() call.
+ * Blank ranges, and pages written or erased in the meantime, are
+ * skipped.  Dropped whenever the erase tracking gets cleared.
+ */
+void board_flash_preerase(uint32_t addr, uint32_t len);
+bool board_flash_preerase_pending(void);
+
+/*
+ * Same stepping, to blank a whole range (slots) ahead of time.
+ * Kept across erase tracking clears, but dropped as soon as
+ * upload data is written.  Progress in bytes, true while pending.
+ */
+void board_flash_wipe(uint32_t addr, uint32_t len);
+bool board_flash_wipe_progress(uint32_t * done, uint32_t * total);
+
+// main loop: one pending sector write-back, pre-erase or wipe step per call,
+// or none while a load out of flash holds board_flash_lock()
+void board_flash_task(void);
+
 // Flush/Sync flash contents
 void board_flash_flush(void);
 
@@ -22,6 +22,7 @@
 #include "config_defaults/sys_version.h"
 #include "board_includes.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include "board_config.h"
 #include "board_config_defaults.h"
 #include "debug.h"
@@ -34,9 +35,159 @@ static  BoardConfig _board_conf_singleton_obj = {0};
 
 static BoardConfig * _board_conf_singleton_ptr = &_board_conf_singleton_obj;
 static bool _boardconf_is_init = false;
+// slot as last written to flash, selection may differ until saved
+static uint8_t _boardconf_saved_slot = 0;
 
+/*
+ * Config journal: saves append a record to the reserved config
+ * sectors, rather than erasing and rewriting a single block, and
+ * boot picks the valid record with the highest sequence number.
+ * Once a sector is full the next record goes at the start of the
+ * following one, whose erase happens then.  That way the newest
+ * config is always intact in flash, and erases drop to one every
+ * BOARDCONF_JOURNAL_RECORDS_PER_SECTOR saves.
+ * Configs from before the journal (a UF2_Block at
+ * BOARD_CONFIG_FLASHADDRESS) are still read if no record is found.
+ */
+#define BOARDCONF_JOURNAL_MAGIC		0x4A434652UL /* "RFCJ" */
+#define BOARDCONF_JOURNAL_SIZE		(MARKER_RESERVED_SPACE)
+#define BOARDCONF_JOURNAL_SECTORS	(BOARDCONF_JOURNAL_SIZE / FLASH_SECTOR_SIZE)
+
+typedef struct RIF_PACKED_STRUCT boardconfjournalheaderstruct {
+	uint32_t magic;
+	uint32_t crc32; // of everything after this field
+	uint32_t sequence;
+	uint16_t length; // of the config following
+	uint16_t reserved;
+} BoardConfigJournalHeader;
+
+// records are padded to flash pages, so each one is a plain program
+#define BOARDCONF_JOURNAL_RECORD_SIZE \
+	((((sizeof(BoardConfigJournalHeader) + sizeof(BoardConfig)) + 255) / 256) * 256)
+#define BOARDCONF_JOURNAL_RECORDS_PER_SECTOR	(FLASH_SECTOR_SIZE / BOARDCONF_JOURNAL_RECORD_SIZE)
+#define BOARDCONF_JOURNAL_RECORDS \
+	(BOARDCONF_JOURNAL_RECORDS_PER_SECTOR * BOARDCONF_JOURNAL_SECTORS)
+
+static uint32_t _boardconf_journal_seq = 0;
+static int16_t _boardconf_journal_newest = -1;
+
+
+/*
+ * Timing defaults per FPGAFamily.  Unset is what configs
+ * saved before profiles existed get: the fixed delays the
+ * programming sequence always used, unchanged.  Generic has
+ * the same totals but polls CDONE; iCE40 numbers are the
+ * TN1248 slave SPI minimums (CRESET_B low >= 200ns, 1200us
+ * before clocking on the larger parts) with a little margin.
+ */
+static const FPGATimingProfile fpga_family_timing[FPGAFamilyNUM] = {
+		[FPGAFamilyUnset] = {
+				.family = FPGAFamilyUnset,
+				.reset_hold_us = 10000,
+				.release_wait_us = 8000,
+				.reset_settle_us = (FLASH_RESET_DELAY_MS * 1000),
+				.cdone_timeout_us = 100000
+		},
+		[FPGAFamilyGeneric] = {
+				.family = FPGAFamilyGeneric,
+				.reset_hold_us = 10000,
+				.release_wait_us = 8000,
+				.reset_settle_us = (FLASH_RESET_DELAY_MS * 1000),
+				.cdone_timeout_us = 100000
+		},
+		[FPGAFamilyICE40] = {
+				.family = FPGAFamilyICE40,
+				.reset_hold_us = 2,
+				.release_wait_us = 1300,
+				.reset_settle_us = 10,
+				.cdone_timeout_us = 10000
+		},
+};
 
 static void board_config_reinit(void);
+static uint32_t journal_crc32(const uint8_t *data, uint32_t len) {
+	uint32_t crc = 0xffffffff;
+	for (uint32_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (uint8_t b = 0; b < 8; b++) {
+			crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+static uint32_t journal_record_address(uint16_t idx) {
+	return (BOARD_CONFIG_FLASHADDRESS) + (idx * BOARDCONF_JOURNAL_RECORD_SIZE);
+}
+
+static bool journal_record_valid(uint16_t idx) {
+	const BoardConfigJournalHeader *hdr =
+			(const BoardConfigJournalHeader*) board_flash_xip(journal_record_address(idx));
+	// length may differ across versions, boardconfig_init()
+	// deals with that as it always has, through the version
+	if (hdr->magic != BOARDCONF_JOURNAL_MAGIC
+			|| hdr->length > (BOARDCONF_JOURNAL_RECORD_SIZE - sizeof(BoardConfigJournalHeader))) {
+		return false;
+	}
+	const uint8_t *covered = (const uint8_t*) &hdr->sequence;
+	uint32_t covered_len = sizeof(BoardConfigJournalHeader)
+			- offsetof(BoardConfigJournalHeader, sequence) + hdr->length;
+	return journal_crc32(covered, covered_len) == hdr->crc32;
+}
+
+static bool journal_record_blank(uint16_t idx) {
+	const uint32_t *w = (const uint32_t*) board_flash_xip(journal_record_address(idx));
+	for (uint16_t i = 0; i < (BOARDCONF_JOURNAL_RECORD_SIZE / sizeof(uint32_t)); i++) {
+		if (w[i] != 0xffffffff) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// finds the newest valid record, returns its config or NULL
+static const BoardConfig * journal_scan(void) {
+	_boardconf_journal_newest = -1;
+	_boardconf_journal_seq = 0;
+	for (uint16_t i = 0; i < BOARDCONF_JOURNAL_RECORDS; i++) {
+		if (!journal_record_valid(i)) {
+			continue;
+		}
+		const BoardConfigJournalHeader *hdr =
+				(const BoardConfigJournalHeader*) board_flash_xip(journal_record_address(i));
+		if (_boardconf_journal_newest < 0 || hdr->sequence > _boardconf_journal_seq) {
+			_boardconf_journal_newest = i;
+			_boardconf_journal_seq = hdr->sequence;
+		}
+	}
+	if (_boardconf_journal_newest < 0) {
+		return NULL;
+	}
+	return (const BoardConfig*) (board_flash_xip(
+			journal_record_address(_boardconf_journal_newest))
+			+ sizeof(BoardConfigJournalHeader));
+}
+
+static uint16_t journal_next_record(void) {
+	if (_boardconf_journal_newest < 0) {
+		// first record: anywhere blank, so an old style config
+		// stays readable until this one is safely written
+		for (uint16_t i = 0; i < BOARDCONF_JOURNAL_RECORDS; i++) {
+			if (journal_record_blank(i)) {
+				return i;
+			}
+		}
+		return 0;
+	}
+	uint16_t next = _boardconf_journal_newest + 1;
+	if ((next % BOARDCONF_JOURNAL_RECORDS_PER_SECTOR) && journal_record_blank(next)) {
+		return next;
+	}
+	// on to the start of the following sector, which gets erased
+	uint16_t sector = _boardconf_journal_newest / BOARDCONF_JOURNAL_RECORDS_PER_SECTOR;
+	return ((sector + 1) % BOARDCONF_JOURNAL_SECTORS) * BOARDCONF_JOURNAL_RECORDS_PER_SECTOR;
+}
+
 
 static bool version_mismatch(const VersionInfo const * v1, const VersionInfo const * v2);
 
@@ -56,15 +207,22 @@ void boardconfig_init(void) {
 
 	_boardconf_is_init = true;
 	UF2_Block config_block;
-	board_flash_read(BOARD_CONFIG_FLASHADDRESS, &config_block,
-			sizeof(UF2_Block));
+	const uint8_t *stored_config = (const uint8_t*) journal_scan();
+	if (stored_config == NULL) {
+		// nothing journaled yet, maybe an old style config block
+		board_flash_read(BOARD_CONFIG_FLASHADDRESS, &config_block,
+				sizeof(UF2_Block));
+		if (config_block.magicStart0 == UF2_MAGIC_START0
+				&& config_block.magicStart1 == BOARDCONF_UF2_MAGIC_START1
+				&& config_block.magicEnd == BOARDCONF_UF2_MAGIC_END
+				&& config_block.familyID == BOARDCONF_UF2_FAMILY_ID) {
+			stored_config = config_block.data;
+		}
+	}
 
-	if (config_block.magicStart0 == UF2_MAGIC_START0
-			&& config_block.magicStart1 == BOARDCONF_UF2_MAGIC_START1
-			&& config_block.magicEnd == BOARDCONF_UF2_MAGIC_END
-			&& config_block.familyID == BOARDCONF_UF2_FAMILY_ID) {
+	if (stored_config != NULL) {
 		DEBUG_LN("Have valid board config!");
-		memcpy(&testBC, config_block.data, sizeof(BoardConfig));
+		memcpy(&testBC, stored_config, sizeof(BoardConfig));
 		if (version_mismatch(&testBC.version, &curVer) == true) {
 			// use something valid
 			board_config_reinit();
@@ -73,13 +231,13 @@ void boardconfig_init(void) {
 					sizeof(VersionInfo));
 		} else {
 			// flash data all good
-			memcpy(&_board_conf_singleton_obj, config_block.data,
-					sizeof(BoardConfig));
+			memcpy(&_board_conf_singleton_obj, &testBC, sizeof(BoardConfig));
 		}
 	} else {
 		DEBUG_LN("No config block--initializing");
 		boardconfig_factoryreset(false);
 	}
+	_boardconf_saved_slot = boardconfig_selected_bitstream_slot();
 }
 
 void boardconfig_factoryreset(bool erase_bitstreams) {
@@ -108,6 +266,15 @@ BoardConfigPtrConst boardconfig_get(void) {
 uint32_t boardconfig_autoclocking_achieved(uint8_t idx) {
 	return (uint32_t)clock_pwm_freq_achieved(boardconfig_autoclocking(idx));
 }
+const FPGATimingProfile * boardconfig_fpga_timing(void) {
+	const FPGATimingProfile * timing = &(_board_conf_singleton_ptr->fpga_timing);
+	if (timing->family == FPGAFamilyUnset || timing->family >= FPGAFamilyNUM) {
+		// zeroed (pre-profile) config: behave as it always did
+		return &fpga_family_timing[FPGAFamilyUnset];
+	}
+	return timing;
+}
+
 FPGA_PWM* boardconfig_autoclocking(uint8_t idx) {
 	if (idx > 1) {
 		return NULL;
@@ -227,6 +394,7 @@ void board_config_reinit(void) {
 #endif
 					.pin_reset = PIN_FPGA_RESET,
 					.reset_inverted = FPGA_RESET_INVERTED,
+					.transport = FPGA_CRAM_TRANSPORT,
 			},
 
 			.uart_bridge = {
@@ -271,6 +439,9 @@ void board_config_reinit(void) {
 
 	}
 
+	// FPGA programming delays
+	memcpy(&bc.fpga_timing, &fpga_family_timing[FPGA_FAMILY], sizeof(FPGATimingProfile));
+
 	// clocking
 	bc.clocking[0].enabled = AUTOCLOCK1_DEFAULT_ENABLE;
 	bc.clocking[0].freq_hz = AUTOCLOCK1_DEFAULT_FREQ;
@@ -329,23 +500,30 @@ void boardconfig_dump(void) {
 }
 
 void boardconfig_write(void) {
-	UF2_Block config_block;
-    config_block.magicStart0 = UF2_MAGIC_START0;
-    config_block.magicStart1 = BOARDCONF_UF2_MAGIC_START1;
-    config_block.magicEnd = BOARDCONF_UF2_MAGIC_END;
-    config_block.familyID = BOARDCONF_UF2_FAMILY_ID;
-    config_block.flags = UF2_FLAG_FAMILYID | UF2_FLAG_NOFLASH;
-    config_block.blockNo = 1;
-    config_block.numBlocks = 1;
-    config_block.payloadSize = sizeof(BoardConfig);
-
-    memcpy(config_block.data, _board_conf_singleton_ptr, sizeof(BoardConfig));
-
-
-    DEBUG_LN("Writing config");
-    board_flash_write(BOARD_CONFIG_FLASHADDRESS, &config_block, sizeof(config_block));
-    board_flash_pages_erased_clear();
-    sleep_ms(10);
+	static uint8_t record[BOARDCONF_JOURNAL_RECORD_SIZE];
+	BoardConfigJournalHeader *hdr = (BoardConfigJournalHeader*) record;
+	uint16_t idx = journal_next_record();
+
+	memset(record, 0xff, sizeof(record));
+	hdr->magic = BOARDCONF_JOURNAL_MAGIC;
+	hdr->sequence = _boardconf_journal_seq + 1;
+	hdr->length = sizeof(BoardConfig);
+	hdr->reserved = 0;
+	memcpy(&record[sizeof(BoardConfigJournalHeader)], _board_conf_singleton_ptr,
+			sizeof(BoardConfig));
+	hdr->crc32 = journal_crc32((const uint8_t*) &hdr->sequence,
+			sizeof(BoardConfigJournalHeader)
+					- offsetof(BoardConfigJournalHeader, sequence)
+					+ sizeof(BoardConfig));
+
+	DEBUG("Writing config record ");
+	DEBUG_U16_LN(idx);
+	// blank slot: program only, start of a used sector: erase first
+	board_flash_write(journal_record_address(idx), record, sizeof(record));
+	_boardconf_journal_seq = hdr->sequence;
+	_boardconf_journal_newest = idx;
+	_boardconf_saved_slot = boardconfig_selected_bitstream_slot();
+	board_flash_pages_erased_clear();
 }
 
 
@@ -413,6 +591,10 @@ uint8_t boardconfig_selected_bitstream_slot(void) {
 	return _board_conf_singleton_ptr->bin_position.selected_slot;
 }
 
+bool boardconfig_bitstream_slot_saved(void) {
+	return _boardconf_saved_slot == boardconfig_selected_bitstream_slot();
+}
+
 void boardconfig_set_bitstream_slot(uint8_t s) {
 	if (s < POSITION_SLOTS_ALLOWED) {
 		/* keep both in sync -- this is redundant, but
@@ -100,15 +100,38 @@ typedef struct RIF_PACKED_STRUCT spi_config_struct {
 	uint8_t pin_mosi;
 } SPIConfig;
 
+typedef enum cramtransportenum {
+	CRAMTransportSPI=0, /* RP2 hardware SPI block */
+	CRAMTransportPIO=1  /* PIO state machine, any pins, up to clk_sys/2 */
+} CRAMTransport;
+
 // 16 bytes
 typedef struct RIF_PACKED_STRUCT fpga_cram_config {
 	SPIConfig spi; // 12
-	uint8_t res1;
+	uint8_t transport; // a CRAMTransport
 	uint8_t pin_done;
 	uint8_t pin_reset;
 	uint8_t reset_inverted;
 } FPGACRAMConfig;
 
+typedef enum fpgafamilyenum {
+	FPGAFamilyUnset=0,   /* configs saved before timing profiles existed */
+	FPGAFamilyGeneric=1, /* conservative, the original fixed delays */
+	FPGAFamilyICE40=2,   /* Lattice iCE40 LP/HX/UltraPlus slave SPI */
+	FPGAFamilyNUM
+} FPGAFamily;
+
+// 16 bytes, all delays in microseconds
+typedef struct RIF_PACKED_STRUCT fpga_timing_struct {
+	uint8_t  family; // an FPGAFamily
+	uint8_t  res1;
+	uint16_t reset_hold_us; // reset and CS asserted, entering programming mode
+	uint16_t release_wait_us; // after reset release, before first clocks
+	uint16_t reset_settle_us; // after any other reset line change
+	uint32_t cdone_timeout_us; // max wait for CDONE after the last byte
+	uint32_t res2;
+} FPGATimingProfile;
+
 typedef enum switchfunctionenum {
 	SwitchFunctionNOTSET=0,
 	SwitchFunctionReset=1,
@@ -173,7 +196,8 @@ typedef struct RIF_PACKED_STRUCT   board_config_struct {
 
 	UserSwitch switches[BOARD_MAX_NUM_SWITCHES];// 8*4 = 32
 	uint8_t user_app_data[8]; 			// 8, free to use by applications, won't be touched by low-level
-	uint8_t reserved[64];				// 64 for future expansions, without impact to user payload below
+	FPGATimingProfile fpga_timing;		// 16
+	uint8_t reserved[48];				// 48 for future expansions, without impact to user payload below
 										// -----
 										// 280, so 476 - 280 = 196 free bytes in payload
 } BoardConfig ;
@@ -211,6 +235,8 @@ uint8_t	 boardconfig_managedpin_projreset(void);
 
 uint8_t boardconfig_selected_bitstream_slot(void);
 void boardconfig_set_bitstream_slot(uint8_t s);
+// false if the selection was changed but not yet written
+bool boardconfig_bitstream_slot_saved(void);
 
 void boardconfig_uartbridge_enable();
 void boardconfig_uartbridge_disable();
@@ -222,6 +248,10 @@ void boardconfig_dump(void);
 
 
 
+// effective profile, falls back on the legacy fixed
+// delays for configs that predate profiles
+const FPGATimingProfile * boardconfig_fpga_timing(void);
+
 FPGA_PWM * boardconfig_autoclocking(uint8_t idx);
 uint32_t boardconfig_autoclocking_achieved(uint8_t idx);
 
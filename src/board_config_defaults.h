@@ -40,6 +40,18 @@
 #define PICO_DEFAULT_LED_PIN	PIN_RP_LED
 #endif
 
+#ifndef FPGA_CRAM_TRANSPORT
+#define FPGA_CRAM_TRANSPORT	0 /* CRAMTransportSPI */
+#endif
+
+#ifndef FPGA_FAMILY
+#define FPGA_FAMILY	2 /* FPGAFamilyICE40 */
+#endif
+
+#ifndef BS_CACHE_SIZE_BYTES
+#define BS_CACHE_SIZE_BYTES	(104 * 1024) /* one UP5K or two HX1K images */
+#endif
+
 #ifndef BOARD_TUD_MAX_SPEED
 #define BOARD_TUD_MAX_SPEED	1
 #endif
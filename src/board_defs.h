@@ -36,9 +36,12 @@
 
 #define BOARD_FLASH_SIZE  		(512 * 1024)
 #define BOARD_FLASH_ADDR_ZERO   0
+// span of flash covered by the erase/program tracking in board.c
+#define BOARD_FLASH_TRACKED_SIZE	(4 * 1024 * 1024)
 // Comes from #define hardware_flash/include/hardware/flash.h FLASH_SECTOR_SIZE		(4*1024)
 
 #define FLASH_SPI_XFER_BLOCKSIZE 	256 /* keep it short so we stay responsive */
+#define BS_CACHE_XFER_BLOCKSIZE		4096 /* DMA chunks when programming from RAM */
 
 
 #define UF2_MAGIC_START0    0x0A324655UL // "UF2\n"
@@ -31,6 +31,8 @@
 #include "pico/flash.h"
 #include "hardware/flash.h"
 #include "hardware/watchdog.h"
+#include "hardware/dma.h"
+#include "pico/mutex.h"
 
 // #include "pico/time.h"
 
@@ -0,0 +1,195 @@
+/*
+ * bs_cache.c, part of the riffpga project
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bs_cache.h"
+#include "board_config_defaults.h"
+
+#if BS_CACHE_SIZE_BYTES > 0
+
+typedef struct bscachestatestruct {
+	BS_Cache_Entry entries[BS_CACHE_MAX_ENTRIES];
+	uint32_t use_count;
+	// bumped by invalidation, so a fill that raced with
+	// a marker change never becomes valid
+	volatile uint32_t generation;
+	uint32_t fill_generation;
+	int8_t filling;
+	volatile bool claimed;
+} BS_Cache_State;
+
+static uint8_t bs_cache_arena[BS_CACHE_SIZE_BYTES] __attribute__((aligned(4)));
+static BS_Cache_State bs_cache_state = { .filling = -1 };
+
+static bool bs_cache_key_match(const BS_Cache_Key *a, const BS_Cache_Key *b) {
+	return (a->start_address == b->start_address) && (a->size == b->size)
+			&& (a->stream_size == b->stream_size) && (a->flags == b->flags)
+			&& (a->crc32 == b->crc32);
+}
+
+const uint8_t* bs_cache_lookup(const BS_Cache_Key *key) {
+	if (bs_cache_state.claimed) {
+		return NULL;
+	}
+	for (uint8_t i = 0; i < BS_CACHE_MAX_ENTRIES; i++) {
+		BS_Cache_Entry *e = &bs_cache_state.entries[i];
+		if (e->valid && bs_cache_key_match(&e->key, key)) {
+			e->last_used = ++bs_cache_state.use_count;
+			e->hits++;
+			return &bs_cache_arena[e->offset];
+		}
+	}
+	return NULL;
+}
+
+static int8_t bs_cache_lru(void) {
+	int8_t lru = -1;
+	for (uint8_t i = 0; i < BS_CACHE_MAX_ENTRIES; i++) {
+		BS_Cache_Entry *e = &bs_cache_state.entries[i];
+		if (!e->valid) {
+			continue;
+		}
+		if (lru < 0 || e->last_used < bs_cache_state.entries[lru].last_used) {
+			lru = i;
+		}
+	}
+	return lru;
+}
+
+static int8_t bs_cache_free_entry(void) {
+	for (uint8_t i = 0; i < BS_CACHE_MAX_ENTRIES; i++) {
+		if (!bs_cache_state.entries[i].valid) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+uint8_t* bs_cache_fill_begin(const BS_Cache_Key *key) {
+	uint32_t len = key->stream_size;
+	bs_cache_state.filling = -1;
+	if (bs_cache_state.claimed || !len || len > BS_CACHE_SIZE_BYTES) {
+		return NULL;
+	}
+
+	// anything else from that flash location is history
+	for (uint8_t i = 0; i < BS_CACHE_MAX_ENTRIES; i++) {
+		if (bs_cache_state.entries[i].key.start_address == key->start_address) {
+			bs_cache_state.entries[i].valid = false;
+		}
+	}
+
+	int8_t slot = bs_cache_free_entry();
+	if (slot < 0) {
+		bs_cache_state.entries[bs_cache_lru()].valid = false;
+		slot = bs_cache_free_entry();
+	}
+
+	/*
+	 * at most one other image is left: go after it, or
+	 * before it, or evict it.
+	 */
+	uint32_t offset = 0;
+	int8_t other = bs_cache_lru();
+	if (other >= 0) {
+		BS_Cache_Entry *o = &bs_cache_state.entries[other];
+		uint32_t o_end = o->offset + o->key.stream_size;
+		if ((BS_CACHE_SIZE_BYTES - o_end) >= len) {
+			offset = o_end;
+		} else if (o->offset < len) {
+			o->valid = false;
+		}
+	}
+
+	BS_Cache_Entry *e = &bs_cache_state.entries[slot];
+	memcpy(&e->key, key, sizeof(BS_Cache_Key));
+	e->offset = offset;
+	e->hits = 0;
+	e->valid = false;
+	bs_cache_state.filling = slot;
+	bs_cache_state.fill_generation = bs_cache_state.generation;
+	return &bs_cache_arena[offset];
+}
+
+void bs_cache_fill_end(bool success) {
+	if (bs_cache_state.filling < 0) {
+		return;
+	}
+	BS_Cache_Entry *e = &bs_cache_state.entries[bs_cache_state.filling];
+	bs_cache_state.filling = -1;
+	if (!success || bs_cache_state.fill_generation != bs_cache_state.generation) {
+		return;
+	}
+	e->last_used = ++bs_cache_state.use_count;
+	e->valid = true;
+}
+
+void bs_cache_invalidate(void) {
+	bs_cache_state.generation++;
+	for (uint8_t i = 0; i < BS_CACHE_MAX_ENTRIES; i++) {
+		bs_cache_state.entries[i].valid = false;
+	}
+}
+
+uint8_t* bs_cache_claim(void) {
+	bs_cache_state.claimed = true;
+	bs_cache_invalidate();
+	return bs_cache_arena;
+}
+
+void bs_cache_release(void) {
+	bs_cache_state.claimed = false;
+}
+
+uint32_t bs_cache_capacity(void) {
+	return BS_CACHE_SIZE_BYTES;
+}
+
+const BS_Cache_Entry* bs_cache_entry(uint8_t idx) {
+	if (idx >= BS_CACHE_MAX_ENTRIES || !bs_cache_state.entries[idx].valid) {
+		return NULL;
+	}
+	return &bs_cache_state.entries[idx];
+}
+
+#else
+/* cache disabled */
+
+const uint8_t* bs_cache_lookup(const BS_Cache_Key *key) {
+	return NULL;
+}
+uint8_t* bs_cache_fill_begin(const BS_Cache_Key *key) {
+	return NULL;
+}
+void bs_cache_fill_end(bool success) {
+}
+void bs_cache_invalidate(void) {
+}
+uint8_t* bs_cache_claim(void) {
+	return NULL;
+}
+void bs_cache_release(void) {
+}
+uint32_t bs_cache_capacity(void) {
+	return 0;
+}
+const BS_Cache_Entry* bs_cache_entry(uint8_t idx) {
+	return NULL;
+}
+#endif
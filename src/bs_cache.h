@@ -0,0 +1,79 @@
+/*
+ * bs_cache.h, part of the riffpga project
+ *
+ * SRAM cache of recently programmed bitstreams, so flipping
+ * between a couple of designs doesn't go back to flash each
+ * time.  Entries hold the bytes as clocked into the FPGA
+ * (i.e. already expanded, for compressed slots) and are keyed
+ * on the slot marker contents, CRC included, so a re-upload
+ * never hits a stale image.
+ *
+ * Sized by BS_CACHE_SIZE_BYTES, 0 disables it.
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_BS_CACHE_H_
+#define SRC_BS_CACHE_H_
+
+#include "board_includes.h"
+
+#define BS_CACHE_MAX_ENTRIES	2
+
+typedef struct bscachekeystruct {
+	uint32_t start_address; // in flash
+	uint32_t size; // in flash
+	uint32_t stream_size; // as clocked out
+	uint8_t flags; // bitstream meta flags
+	uint32_t crc32; // from the marker, 0 unless BITSTREAM_FLAG_CRC32
+} BS_Cache_Key;
+
+typedef struct bscacheentrystruct {
+	BS_Cache_Key key;
+	uint32_t offset;
+	uint32_t last_used;
+	uint32_t hits;
+	bool valid;
+} BS_Cache_Entry;
+
+// NULL on a miss
+const uint8_t * bs_cache_lookup(const BS_Cache_Key * key);
+
+/*
+ * Fill protocol: begin returns where to put stream_size bytes
+ * (NULL if it can't fit), end makes the entry available, unless
+ * things were invalidated in the meantime or success is false.
+ */
+uint8_t * bs_cache_fill_begin(const BS_Cache_Key * key);
+void bs_cache_fill_end(bool success);
+
+// call whenever slot markers change
+void bs_cache_invalidate(void);
+
+/*
+ * Volatile (RAM only) uploads borrow the whole arena: claiming
+ * drops every entry and keeps lookups and fills away from it
+ * until released.  NULL if the cache is disabled.
+ */
+uint8_t * bs_cache_claim(void);
+void bs_cache_release(void);
+
+uint32_t bs_cache_capacity(void);
+// NULL if idx isn't a valid entry
+const BS_Cache_Entry * bs_cache_entry(uint8_t idx);
+
+#endif /* SRC_BS_CACHE_H_ */
@@ -0,0 +1,81 @@
+/*
+ * bs_rle.c, part of the riffpga project
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "bs_rle.h"
+
+void bs_rle_init(BS_RLE_State *st, const uint8_t *src, uint32_t len) {
+	st->src = src;
+	st->src_end = src + len;
+	st->literal_left = 0;
+	st->run_left = 0;
+	st->run_value = 0;
+}
+
+uint16_t bs_rle_read(BS_RLE_State *st, uint8_t *out, uint16_t maxlen) {
+	uint16_t produced = 0;
+	while (produced < maxlen) {
+		uint16_t space = maxlen - produced;
+		if (st->run_left) {
+			uint16_t n = (st->run_left < space) ? st->run_left : space;
+			memset(&out[produced], st->run_value, n);
+			st->run_left -= n;
+			produced += n;
+		} else if (st->literal_left) {
+			uint32_t avail = (uint32_t) (st->src_end - st->src);
+			uint16_t n = (st->literal_left < space) ? st->literal_left : space;
+			if (n > avail) {
+				// truncated stream, give what we have and stop
+				n = (uint16_t) avail;
+				st->literal_left = n;
+			}
+			if (!n) {
+				break;
+			}
+			memcpy(&out[produced], st->src, n);
+			st->src += n;
+			st->literal_left -= n;
+			produced += n;
+		} else {
+			if (st->src >= st->src_end) {
+				break;
+			}
+			uint8_t ctrl = *(st->src++);
+			if (ctrl <= BS_RLE_LITERAL_MAX) {
+				st->literal_left = (uint16_t) ctrl + 1;
+			} else if (ctrl != BS_RLE_RUN_EXTENDED) {
+				if (st->src >= st->src_end) {
+					break;
+				}
+				st->run_left = (uint16_t) (ctrl - 0x80) + BS_RLE_RUN_MIN;
+				st->run_value = *(st->src++);
+			} else {
+				if ((st->src_end - st->src) < 3) {
+					st->src = st->src_end;
+					break;
+				}
+				st->run_left = (uint16_t) st->src[0] | ((uint16_t) st->src[1] << 8);
+				st->run_value = st->src[2];
+				st->src += 3;
+			}
+		}
+	}
+	return produced;
+}
@@ -0,0 +1,59 @@
+/*
+ * bs_rle.h, part of the riffpga project
+ *
+ * Streaming decoder for run-length compressed bitstreams, as
+ * produced by bin/bitstream_to_uf2.py --compress.
+ *
+ * Encoding is a sequence of control bytes, each followed by data:
+ *   0x00-0x7F  (ctrl + 1) literal bytes follow
+ *   0x80-0xFE  next byte is repeated (ctrl - 0x80 + 3) times
+ *   0xFF       16-bit little-endian count, then the byte to
+ *              repeat count times
+ *
+ * iCE40 bitstreams are mostly long runs of zeros, so this
+ * cheap scheme gets most of what a fancier codec would.
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_BS_RLE_H_
+#define SRC_BS_RLE_H_
+
+#include <stdint.h>
+
+#define BS_RLE_LITERAL_MAX		0x7F
+#define BS_RLE_RUN_EXTENDED		0xFF
+#define BS_RLE_RUN_MIN			3
+
+typedef struct bs_rle_state_struct {
+	const uint8_t * src;
+	const uint8_t * src_end;
+	uint16_t literal_left;
+	uint16_t run_left;
+	uint8_t run_value;
+} BS_RLE_State;
+
+// src is the compressed data, usually straight out of XIP
+void bs_rle_init(BS_RLE_State * st, const uint8_t * src, uint32_t len);
+
+/*
+ * decompress up to maxlen bytes into out, returns the number
+ * of bytes produced.  0 means the stream is exhausted.
+ */
+uint16_t bs_rle_read(BS_RLE_State * st, uint8_t * out, uint16_t maxlen);
+
+#endif /* SRC_BS_RLE_H_ */
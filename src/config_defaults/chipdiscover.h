@@ -161,4 +161,7 @@
 #define FLASH_STORAGE_STARTADDRESS(slotidx)	(FLASH_TARGET_OFFSETSTART + ( (slotidx) * BITSTREAM_SLOT_RESERVED_SPACE))
 
 
+// RP2350, room enough to cache two UP5K images
+#define BS_CACHE_SIZE_BYTES		(2 * 104 * 1024)
+
 #endif /* CONFIG_DEFAULTS_CHIPDISCOVER_H_ */
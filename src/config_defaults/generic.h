@@ -116,6 +116,36 @@
 #define FLASH_SPI_PHASE 		0
 #define FLASH_SPI_BAUDRATE 			4000000UL
 
+/*
+ * FPGA_CRAM_TRANSPORT
+ * 0: use the RP2 hardware SPI block.  Pins must be a valid
+ *    SPI0/SPI1 set.
+ * 1: use a PIO state machine.  Any pins will do, CS is driven
+ *    by the PIO program and FLASH_SPI_BAUDRATE may go up to
+ *    half the system clock (check your FPGA's slave SPI max).
+ *    SPI mode 0 only: with FLASH_SPI_POLARITY or FLASH_SPI_PHASE
+ *    set, the hardware SPI block is used instead.
+ */
+#define FPGA_CRAM_TRANSPORT		0
+
+/*
+ * FPGA_FAMILY
+ * selects the programming timing profile (delays around reset
+ * release, CDONE timeout), see FPGAFamily in board_config.h.
+ * 1: generic, conservative millisecond delays
+ * 2: Lattice iCE40, datasheet minimums
+ */
+#define FPGA_FAMILY				2
+
+/*
+ * BS_CACHE_SIZE_BYTES
+ * SRAM set aside to keep up to two recently programmed
+ * bitstreams, so switching between them skips flash.
+ * An iCE40 UP5K image is 104090 bytes, HX1K 32220.
+ * 0 disables the cache.
+ */
+#define BS_CACHE_SIZE_BYTES		(104 * 1024)
+
 
 /*
  * If you have a "Done" pin hooked-up,
@@ -0,0 +1,121 @@
+/*
+ * cram_pio.c, part of the riffpga project
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "board_includes.h"
+#include "hardware/pio.h"
+#include "cram_pio.h"
+#include "cram_pio.pio.h"
+#include "debug.h"
+
+typedef struct cram_pio_state_struct {
+	bool is_init;
+	PIO pio;
+	uint sm;
+	uint offset;
+} CRAMPIOState;
+
+static CRAMPIOState cram_pio_state = { 0 };
+
+static bool cram_pio_claim(void) {
+	PIO pios[2] = { pio0, pio1 };
+	for (uint8_t i = 0; i < 2; i++) {
+		if (!pio_can_add_program(pios[i], &cram_spi_tx_program)) {
+			continue;
+		}
+		int sm = pio_claim_unused_sm(pios[i], false);
+		if (sm < 0) {
+			continue;
+		}
+		cram_pio_state.pio = pios[i];
+		cram_pio_state.sm = (uint) sm;
+		cram_pio_state.offset = pio_add_program(pios[i], &cram_spi_tx_program);
+		return true;
+	}
+	return false;
+}
+
+bool cram_pio_init(const FPGACRAMConfig *conf) {
+
+	if (conf->spi.polarity || conf->spi.phase) {
+		// the program only shifts on SCK falling, idling low: mode 0
+		if (cram_pio_state.is_init) {
+			pio_sm_set_enabled(cram_pio_state.pio, cram_pio_state.sm, false);
+		}
+		CDCWRITESTRING("\r\nPIO CRAM is SPI mode 0 only, using SPI\r\n");
+		return false;
+	}
+
+	if (!cram_pio_state.is_init) {
+		if (!cram_pio_claim()) {
+			CDCWRITESTRING("\r\nNo PIO SM available for CRAM\r\n");
+			return false;
+		}
+		cram_pio_state.is_init = true;
+	} else {
+		pio_sm_set_enabled(cram_pio_state.pio, cram_pio_state.sm, false);
+	}
+
+	// two PIO cycles per bit
+	float clkdiv = 1.0f;
+	if (conf->spi.rate) {
+		clkdiv = (float) clock_get_hz(clk_sys) / (2.0f * (float) conf->spi.rate);
+	}
+	if (clkdiv < 1.0f) {
+		clkdiv = 1.0f;
+	}
+
+	cram_spi_tx_program_init(cram_pio_state.pio, cram_pio_state.sm,
+			cram_pio_state.offset, clkdiv, conf->spi.pin_mosi,
+			conf->spi.pin_sck, conf->spi.pin_cs);
+
+	// program thinks CS is active low, adjust at the pad
+	gpio_set_outover(conf->spi.pin_cs,
+			conf->spi.cs_inverted ? GPIO_OVERRIDE_NORMAL : GPIO_OVERRIDE_INVERT);
+
+	return true;
+}
+
+bool cram_pio_is_init(void) {
+	return cram_pio_state.is_init;
+}
+
+void cram_pio_select(bool select) {
+	uint entry = select ? cram_spi_tx_offset_select : cram_spi_tx_offset_deselect;
+	pio_sm_exec(cram_pio_state.pio, cram_pio_state.sm,
+			pio_encode_jmp(cram_pio_state.offset + entry));
+}
+
+uint cram_pio_dreq(void) {
+	return pio_get_dreq(cram_pio_state.pio, cram_pio_state.sm, true);
+}
+
+volatile void* cram_pio_txfifo(void) {
+	// 8-bit DMA writes get replicated across the word, so the
+	// byte lands in the MSBs where the left-shifting OSR wants it
+	return &(cram_pio_state.pio->txf[cram_pio_state.sm]);
+}
+
+void cram_pio_drain(void) {
+	uint32_t stall_mask = 1u << (PIO_FDEBUG_TXSTALL_LSB + cram_pio_state.sm);
+	cram_pio_state.pio->fdebug = stall_mask;
+	while (!(cram_pio_state.pio->fdebug & stall_mask)) {
+		tight_loop_contents();
+	}
+}
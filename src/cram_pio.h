@@ -0,0 +1,48 @@
+/*
+ * cram_pio.h, part of the riffpga project
+ *
+ * PIO based transport for CRAM programming, an alternative
+ * to the hardware SPI blocks selected through the
+ * fpga_cram.transport board config.
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_CRAM_PIO_H_
+#define SRC_CRAM_PIO_H_
+
+#include "board_config.h"
+
+/*
+ * claims a state machine (on first call) and sets it up
+ * according to the fpga_cram config.  Returns false if
+ * no PIO resources are available.
+ */
+bool cram_pio_init(const FPGACRAMConfig * conf);
+bool cram_pio_is_init(void);
+
+// CS is driven by the PIO program
+void cram_pio_select(bool select);
+
+// DMA plumbing: data request and destination
+uint cram_pio_dreq(void);
+volatile void * cram_pio_txfifo(void);
+
+// wait until everything queued has been clocked out
+void cram_pio_drain(void);
+
+#endif /* SRC_CRAM_PIO_H_ */
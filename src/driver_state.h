@@ -30,6 +30,7 @@ typedef struct driverstatestruct {
 	bool have_programmed;
 	bool immediate_led_blink;
 	bool clocking_manually;
+	uint8_t program_attempts;
 } DriverState;
 
 extern DriverState MainDriverState;
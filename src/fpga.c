@@ -23,7 +23,10 @@
 #include "board_config.h"
 #include "board_config_defaults.h"
 #include "fpga.h"
+#include "cram_pio.h"
+#include "board.h"
 #include "debug.h"
+#include "hardware/structs/io_bank0.h"
 
 typedef struct fpga_state_struct {
 
@@ -36,12 +39,16 @@ typedef struct fpga_state_struct {
 
 	bool spi_tx_started;
 	uint8_t spi_idx;
+	uint8_t transport;
+	int spi_dma_chan;
+	bool spi_crc32;
 
 } FPGA_State;
 
-static volatile FPGA_State fpgastate = { 0 };
+static volatile FPGA_State fpgastate = { .spi_dma_chan = -1 };
 
 #define SPIDEVICE(fpgastate) (fpgastate.spi_idx == 0 ? spi0 : spi1)
+#define CRAM_USES_PIO(fpgastate) (fpgastate.transport == CRAMTransportPIO)
 
 #define FPGA_DEBUG_ENABLE
 #ifdef FPGA_DEBUG_ENABLE
@@ -106,6 +113,23 @@ static void fpga_set_reset_pin_dir(uint8_t dir) {
 	fpgastate.pin_reset_dir = dir;
 	gpio_set_dir(fpgastate.pin_reset, dir);
 }
+/*
+ * gpio_set_irq_enabled() works on the calling core's enables,
+ * but fpga_reset() gets called by the programming worker on
+ * core 1 while the monitor's handler lives on core 0.
+ */
+static void fpga_reset_monitor_irq(uint gpio, uint32_t events, bool do_enable) {
+	io_rw_32 *en_reg = &io_bank0_hw->proc0_irq_ctrl.inte[gpio / 8];
+	uint32_t mask = events << (4 * (gpio % 8));
+	if (do_enable) {
+		// as gpio_set_irq_enabled() does, clear stale edges first
+		gpio_acknowledge_irq(gpio, events);
+		hw_set_bits(en_reg, mask);
+	} else {
+		hw_clear_bits(en_reg, mask);
+	}
+}
+
 static void fpga_reset_monitor_enable(BoardConfigPtrConst bc, bool do_enable) {
 
 	if (do_enable == true) {
@@ -115,10 +139,10 @@ static void fpga_reset_monitor_enable(BoardConfigPtrConst bc, bool do_enable) {
 	fpgastate.reset_switch_enabled = false;
 	if (bc->fpga_cram.reset_inverted) {
 
-		gpio_set_irq_enabled(bc->fpga_cram.pin_reset, GPIO_IRQ_EDGE_RISE,
+		fpga_reset_monitor_irq(bc->fpga_cram.pin_reset, GPIO_IRQ_EDGE_RISE,
 				do_enable);
 	} else {
-		gpio_set_irq_enabled(bc->fpga_cram.pin_reset, GPIO_IRQ_EDGE_FALL,
+		fpga_reset_monitor_irq(bc->fpga_cram.pin_reset, GPIO_IRQ_EDGE_FALL,
 				do_enable);
 
 	}
@@ -126,16 +150,30 @@ static void fpga_reset_monitor_enable(BoardConfigPtrConst bc, bool do_enable) {
 }
 
 static void fpga_init_cs_line(BoardConfigPtrConst bc) {
+	if (CRAM_USES_PIO(fpgastate)) {
+		// CS belongs to the PIO program, set up in fpga_init()
+		return;
+	}
 	gpio_init(bc->fpga_cram.spi.pin_cs);
 	gpio_set_dir(bc->fpga_cram.spi.pin_cs, GPIO_OUT);
 	gpio_put(bc->fpga_cram.spi.pin_cs, bc->fpga_cram.spi.cs_inverted);
 }
-void fpga_init(void) {
 
-	uint8_t spi0_scks[] = { 2, 6, 18, 22, 0xff };
+static void fpga_cs_select(BoardConfigPtrConst bc, bool select) {
+	if (CRAM_USES_PIO(fpgastate)) {
+		cram_pio_select(select);
+		return;
+	}
+	if (select) {
+		gpio_put(bc->fpga_cram.spi.pin_cs, !bc->fpga_cram.spi.cs_inverted);
+	} else {
+		gpio_put(bc->fpga_cram.spi.pin_cs, bc->fpga_cram.spi.cs_inverted);
+	}
+}
 
-	BoardConfigPtrConst bc = boardconfig_get();
+static void fpga_init_hw_spi(BoardConfigPtrConst bc) {
 
+	uint8_t spi0_scks[] = { 2, 6, 18, 22, 0xff };
 	uint8_t i = 0;
 	fpgastate.spi_idx = 1;
 	while (spi0_scks[i] != 0xff) {
@@ -154,6 +192,28 @@ void fpga_init(void) {
 	spi_set_format(SPIDEVICE(fpgastate), 8, bc->fpga_cram.spi.polarity,
 			bc->fpga_cram.spi.phase,
 			bc->fpga_cram.spi.order /* unused... must be MSB */);
+}
+
+uint8_t fpga_cram_transport(void) {
+	return fpgastate.transport;
+}
+
+void fpga_init(void) {
+
+	BoardConfigPtrConst bc = boardconfig_get();
+
+	fpgastate.transport = bc->fpga_cram.transport;
+	if (CRAM_USES_PIO(fpgastate) && !cram_pio_init(&(bc->fpga_cram))) {
+		FPGA_DEBUG_LN("PIO CRAM unavailable, using SPI");
+		fpgastate.transport = CRAMTransportSPI;
+	}
+	if (!CRAM_USES_PIO(fpgastate)) {
+		fpga_init_hw_spi(bc);
+	}
+
+	if (fpgastate.spi_dma_chan < 0) {
+		fpgastate.spi_dma_chan = dma_claim_unused_channel(true);
+	}
 
 	fpgastate.pin_reset = bc->fpga_cram.pin_reset;
 	gpio_init(bc->fpga_cram.pin_reset);
@@ -248,8 +308,7 @@ bool fpga_is_in_reset(void) {
 
 	return false;
 }
-void fpga_reset(bool set_to) {
-	BoardConfigPtrConst bc = boardconfig_get();
+static void fpga_reset_line(BoardConfigPtrConst bc, bool set_to) {
 	if (set_to) {
 		FPGA_DEBUG_LN("Resetting FPGA");
 		fpgastate.reset_switch_enabled = false;
@@ -266,7 +325,7 @@ void fpga_reset(bool set_to) {
 		FPGA_DEBUG_LN("FPGA Reset RELEASE");
 
 		// about to release from reset, ensure we tell it it's in slave mode
-		gpio_put(bc->fpga_cram.spi.pin_cs, !bc->fpga_cram.spi.cs_inverted);
+		fpga_cs_select(bc, true);
 		// now release
 		gpio_put(bc->fpga_cram.pin_reset, bc->fpga_cram.reset_inverted);
 		if (bc->system.fpga_reset_external_trigger) {
@@ -275,8 +334,12 @@ void fpga_reset(bool set_to) {
 
 		fpgastate.in_reset = false;
 	}
+}
 
-	sleep_ms(FLASH_RESET_DELAY_MS);
+void fpga_reset(bool set_to) {
+	BoardConfigPtrConst bc = boardconfig_get();
+	fpga_reset_line(bc, set_to);
+	sleep_us(boardconfig_fpga_timing()->reset_settle_us);
 }
 bool fpga_in_reset(void) {
 	return fpgastate.in_reset;
@@ -304,26 +367,55 @@ bool fpga_is_programmed(void) {
 #endif
 }
 
+bool fpga_wait_programmed(void) {
+	const FPGATimingProfile * timing = boardconfig_fpga_timing();
+	uint32_t timeout_us = timing->cdone_timeout_us;
+	if (timing->family == FPGAFamilyUnset) {
+		// legacy: give CDONE the full settle time, then sample
+		if (fpgastate.is_programmed) {
+			sleep_us(timeout_us);
+		}
+		return fpga_is_programmed();
+	}
+#ifdef FPGA_PROG_DONE_LEVEL
+	uint64_t tstart = time_us_64();
+	while (fpga_is_programmed() == false) {
+		if (fpgastate.is_programmed == false) {
+			// nothing was clocked in, CDONE isn't coming
+			return false;
+		}
+		if ((time_us_64() - tstart) > timeout_us) {
+			return false;
+		}
+		tight_loop_contents();
+	}
+	return true;
+#else
+	return fpga_is_programmed();
+#endif
+}
+
 void fpga_set_programmed(bool set_to) {
 	fpgastate.is_programmed = set_to;
 }
 
 void fpga_enter_programming_mode(void) {
 	BoardConfigPtrConst bc = boardconfig_get();
+	const FPGATimingProfile * timing = boardconfig_fpga_timing();
 	uint8_t dummy_byte = 0;
-	fpga_reset(true);
+	fpga_reset_line(bc, true);
 
 	fpga_spi_transaction_begin(); // cs goes low
 	FPGA_DEBUG_LN("doing progmode reset ");
-	sleep_ms(8);
-	fpga_reset(false); // we disable reset, fpga acts as slave
-	sleep_ms(6); // minimum of 1200us here!
+	sleep_us(timing->reset_hold_us);
+	fpga_reset_line(bc, false); // we disable reset, fpga acts as slave
+	sleep_us(timing->release_wait_us); // iCE40: minimum of 1200us here!
 	// send 8 dummy clocks
-	gpio_put(bc->fpga_cram.spi.pin_cs, bc->fpga_cram.spi.cs_inverted); // release
+	fpga_cs_select(bc, false); // release
 
 	fpga_spi_write(&dummy_byte, 1); // DUMMY BYTE
 	// back to low
-	gpio_put(bc->fpga_cram.spi.pin_cs, !bc->fpga_cram.spi.cs_inverted); // select
+	fpga_cs_select(bc, true); // select
 }
 
 void fpga_exit_programming_mode(void) {
@@ -335,7 +427,7 @@ void fpga_exit_programming_mode(void) {
 
 void fpga_spi_transaction_begin(void) {
 	BoardConfigPtrConst bc = boardconfig_get();
-	gpio_put(bc->fpga_cram.spi.pin_cs, !bc->fpga_cram.spi.cs_inverted); // select
+	fpga_cs_select(bc, true);
 
 	fpgastate.spi_tx_started = true;
 	asm volatile("nop \n nop \n nop");
@@ -343,7 +435,7 @@ void fpga_spi_transaction_begin(void) {
 void fpga_spi_transaction_end(void) {
 
 	BoardConfigPtrConst bc = boardconfig_get();
-	gpio_put(bc->fpga_cram.spi.pin_cs, bc->fpga_cram.spi.cs_inverted); // release
+	fpga_cs_select(bc, false);
 
 	fpgastate.spi_tx_started = false;
 }
@@ -355,12 +447,66 @@ void fpga_spi_write(uint8_t *bts, size_t len) {
 		fpga_spi_transaction_begin();
 	}
 
-	while (spi_is_busy(SPIDEVICE(fpgastate))) {
-		FPGA_DEBUG_LN("spi bzzy");
+	if (CRAM_USES_PIO(fpgastate)) {
+		fpga_spi_write_start(bts, len);
+		fpga_spi_write_wait();
+		fpga_spi_drain();
+	} else {
+		while (spi_is_busy(SPIDEVICE(fpgastate))) {
+			FPGA_DEBUG_LN("spi bzzy");
+		}
+		spi_write_blocking(SPIDEVICE(fpgastate), bts, len);
 	}
-	spi_write_blocking(SPIDEVICE(fpgastate), bts, len);
 
 	if (end_tx) {
 		fpga_spi_transaction_end();
 	}
 }
+
+void fpga_spi_write_start(const uint8_t *bts, size_t len) {
+	dma_channel_config c = dma_channel_get_default_config(fpgastate.spi_dma_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_sniff_enable(&c, fpgastate.spi_crc32);
+	if (CRAM_USES_PIO(fpgastate)) {
+		channel_config_set_dreq(&c, cram_pio_dreq());
+		dma_channel_configure(fpgastate.spi_dma_chan, &c, cram_pio_txfifo(),
+				bts, len, true);
+	} else {
+		channel_config_set_dreq(&c, spi_get_dreq(SPIDEVICE(fpgastate), true));
+		dma_channel_configure(fpgastate.spi_dma_chan, &c,
+				&spi_get_hw(SPIDEVICE(fpgastate))->dr, bts, len, true);
+	}
+}
+
+void fpga_spi_write_wait(void) {
+	dma_channel_wait_for_finish_blocking(fpgastate.spi_dma_chan);
+}
+
+void fpga_spi_crc32_start(void) {
+	fpgastate.spi_crc32 = true;
+	board_crc32_sniff_start(fpgastate.spi_dma_chan);
+}
+
+uint32_t fpga_spi_crc32_end(void) {
+	uint32_t crc = board_crc32_sniff_result();
+	board_crc32_sniff_stop();
+	fpgastate.spi_crc32 = false;
+	return crc;
+}
+
+void fpga_spi_drain(void) {
+	if (CRAM_USES_PIO(fpgastate)) {
+		cram_pio_drain();
+		return;
+	}
+	while (spi_is_busy(SPIDEVICE(fpgastate))) {
+		tight_loop_contents();
+	}
+	// tx-only DMA leaves junk in the RX FIFO, clear it and the overrun flag
+	while (spi_is_readable(SPIDEVICE(fpgastate))) {
+		(void) spi_get_hw(SPIDEVICE(fpgastate))->dr;
+	}
+	spi_get_hw(SPIDEVICE(fpgastate))->icr = SPI_SSPICR_RORIC_BITS;
+}
@@ -36,10 +36,15 @@ void fpga_external_reset_handled(void);
 
 void fpga_debug_spi_pins(void);
 
+// a CRAMTransport: the configured one, unless PIO couldn't be had
+uint8_t fpga_cram_transport(void);
+
 void fpga_enter_programming_mode(void);
 void fpga_exit_programming_mode(void);
 
 bool fpga_is_programmed(void);
+// polls CDONE, bounded by the timing profile's cdone_timeout_us
+bool fpga_wait_programmed(void);
 void fpga_set_programmed(bool set_to);
 void fpga_reset(bool set_to); /* true==in reset */
 bool fpga_in_reset(void);
@@ -50,6 +55,23 @@ void fpga_spi_transaction_begin(void);
 void fpga_spi_transaction_end(void);
 void fpga_spi_write(uint8_t * bts, size_t len);
 
+/*
+ * DMA fed writes, for streaming.  Caller must be within a transaction.
+ * fpga_spi_write_start() returns as soon as the transfer is started,
+ * bts must remain valid until fpga_spi_write_wait() returns.
+ * fpga_spi_write_wait() returns once the last byte is in the TX FIFO,
+ * so the bus keeps shifting while the next transfer is being set up.
+ * fpga_spi_drain() waits for the bus to go idle.
+ */
+void fpga_spi_write_start(const uint8_t * bts, size_t len);
+void fpga_spi_write_wait(void);
+void fpga_spi_drain(void);
+
+// CRC32 of everything fpga_spi_write_start() sends in between,
+// computed by the DMA sniffer as it goes out
+void fpga_spi_crc32_start(void);
+uint32_t fpga_spi_crc32_end(void);
+
 
 
 #endif /* SRC_FPGA_H_ */
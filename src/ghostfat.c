@@ -33,6 +33,10 @@
 #include "bitstream.h"
 #include "board_config.h"
 #include "board_config_defaults.h"
+#include "driver_state.h"
+#include "bs_cache.h"
+#include "prog_worker.h"
+#include "bsp/board_api.h"
 
 //--------------------------------------------------------------------+
 //
@@ -132,9 +136,8 @@ STATIC_ASSERT(BPB_BYTES_PER_CLUSTER                        <= (32*1024)); // FAT
 STATIC_ASSERT(FAT_ENTRIES_PER_SECTOR                       ==       256); // FAT requirement
 
 
+// what the packager uses by default, and the least we serve back
 #define UF2_FIRMWARE_BYTES_PER_SECTOR   256
-#define UF2_SECTOR_COUNT                (_flash_size / UF2_FIRMWARE_BYTES_PER_SECTOR)
-#define UF2_BYTE_COUNT                  (UF2_SECTOR_COUNT * BPB_SECTOR_SIZE) // always a multiple of sector size, per UF2 spec
 
 
 
@@ -228,6 +231,15 @@ static FileContent_t info[] = {
     {.name = "AUTORUN INF", .content = autorunFile , .size = sizeof(autorunFile) - 1},
     {.name = "FAVICON ICO", .content = favicon_data, .size = favicon_len            },
 #endif
+    // slot contents, sized from their markers (zero-length when empty)
+    // and generated from flash like CURRENT.UF2, so no content either
+    {.name = "SLOT1   UF2", .content = NULL       , .size = 0                      },
+    {.name = "SLOT2   UF2", .content = NULL       , .size = 0                      },
+    {.name = "SLOT3   UF2", .content = NULL       , .size = 0                      },
+    // the same, raw: content points straight at the slot's data in XIP
+    {.name = "SLOT1   BIN", .content = NULL       , .size = 0                      },
+    {.name = "SLOT2   BIN", .content = NULL       , .size = 0                      },
+    {.name = "SLOT3   BIN", .content = NULL       , .size = 0                      },
     // current.uf2 must be the last element and its content must be NULL
     {.name = "CURRENT UF2", .content = NULL       , .size = 0                      },
 };
@@ -240,9 +252,13 @@ enum {
 enum {
   FID_INFO = 0,
   FID_INDEX = 1,
+  FID_SLOT1 = NUM_FILES - 1 - (2 * POSITION_SLOTS_ALLOWED),
+  FID_SLOT1_BIN = NUM_FILES - 1 - POSITION_SLOTS_ALLOWED,
   FID_UF2 = NUM_FILES - 1,
 };
 
+STATIC_ASSERT(POSITION_SLOTS_ALLOWED == 3); // one SLOTn.UF2/BIN entry per slot, above
+
 STATIC_ASSERT(NUM_DIRENTRIES < BPB_ROOT_DIR_ENTRIES);  // FAT requirement -- Ensures BPB reserves sufficient entries for all files
 STATIC_ASSERT(NUM_DIRENTRIES < DIRENTRIES_PER_SECTOR); // GhostFAT bug workaround -- else, code overflows buffer
 
@@ -269,6 +285,26 @@ STATIC_ASSERT( CLUSTER_COUNT >= 0x1015 && CLUSTER_COUNT < 0xFFD5 );
 
 static Bitstream_MetaInfo bs_write_metainfo = {0};
 
+/*
+ * Pre-rendered FS sectors, rebuilt whenever the file layout changes.
+ * Files are contiguous, so a FAT sector is a plain run of cluster+1
+ * entries or all free, except the first (media byte, reserved
+ * clusters) and those holding a file's last cluster: only those,
+ * and the root directory's one populated sector, are kept.
+ */
+#define GF_CACHED_FAT_SECTORS	4
+typedef struct ghostfatcachestruct {
+  uint32_t first_unused_cluster;
+  uint16_t fat_sector[GF_CACHED_FAT_SECTORS]; // index within a FAT
+  uint8_t num_fat;
+  uint8_t fat[GF_CACHED_FAT_SECTORS][BPB_SECTOR_SIZE];
+  uint8_t rootdir[BPB_SECTOR_SIZE];
+} GhostFATCache;
+
+static GhostFATCache ghostfat_cache = {0};
+static void ghostfat_cache_build(void);
+static void uf2_raw_drop_cancel(void);
+
 static FAT_BootBlock TINYUF2_CONST BootBlock = {
     .JumpInstruction      = {0xeb, 0x3c, 0x90},
     .OEMInfo              = "UF2 UF2 ",
@@ -385,6 +421,7 @@ static void init_starting_clusters(void) {
 
     start_cluster = info[i].cluster_end + 1;
   }
+  ghostfat_cache_build();
 }
 
 // get file index for file that uses the cluster
@@ -413,23 +450,64 @@ static uint32_t info_index_of(uint32_t cluster) {
 }
 
 
-void uf2_init(void) {
-  // TODO maybe limit to application size only if possible board_flash_app_size()
-  _flash_size = board_flash_size();
+// where each slot's stream starts, for SLOTn.UF2
+static uint32_t slot_stream_address[POSITION_SLOTS_ALLOWED];
+
+// flash slot a generated file reads from, -1 for static content
+static int8_t slot_of_file(uint32_t fid) {
+  if (fid == FID_UF2) {
+    return (int8_t) boardconfig_selected_bitstream_slot();
+  }
+  if (fid >= FID_SLOT1 && fid < FID_SLOT1_BIN) {
+    return (int8_t) (fid - FID_SLOT1);
+  }
+  return -1;
+}
+
+// size SLOTn.UF2/BIN and CURRENT.UF2 exactly, from the markers
+static void uf2_size_slot_files(void) {
+  Bitstream_Marker_State mstate;
+  for (uint8_t i = 0; i < POSITION_SLOTS_ALLOWED; i++) {
+    info[FID_SLOT1 + i].size = 0;
+    info[FID_SLOT1_BIN + i].size = 0;
+    info[FID_SLOT1_BIN + i].content = NULL;
+    slot_stream_address[i] = boardconfig_get()->bin_position.slot_start_address[i];
+    if (bs_load_marker(i, &mstate)) {
+      info[FID_SLOT1 + i].size = mstate.settings.uf2_file_size;
+      // what's in flash: the RLE encoded stream, for compressed slots
+      info[FID_SLOT1_BIN + i].size = mstate.settings.size;
+      info[FID_SLOT1_BIN + i].content = board_flash_xip(mstate.settings.start_address);
+      // packagers put it anywhere in the slot
+      slot_stream_address[i] = mstate.settings.start_address;
+    }
+  }
   info[FID_UF2].size = 0;
-  // update CURRENT.UF2 file size
   if (bs_check_for_marker()) {
 	  info[FID_UF2].size = bs_uf2_file_size();
   }
+  init_starting_clusters();
+}
 
+void uf2_init(void) {
+  // TODO maybe limit to application size only if possible board_flash_app_size()
+  _flash_size = board_flash_size();
+  uf2_size_slot_files();
+  // whatever was being copied over is stale now
+  uf2_raw_drop_cancel();
 
   if (! info[FID_UF2].size ) {
+	  // look again on the first read, in case it shows up
 	  bs_clear_size_check_flag();
-	  // set to max
-	  info[FID_UF2].size = UF2_BYTE_COUNT;
   }
 
   // update INFO_UF2.TXT with flash size if having enough space (8 bytes)
+  // -- only the once, we get re-init'ed after in-place uploads
+  static size_t info_txt_len = 0;
+  if (info_txt_len) {
+	  info[FID_INFO].size = info_txt_len;
+	  init_starting_clusters();
+	  return;
+  }
   size_t txt_len = strlen(infoUf2File);
   size_t const max_len = sizeof(infoUf2File) - 1;
   if ( max_len - txt_len > 8) {
@@ -441,6 +519,7 @@ void uf2_init(void) {
     }
   }
   info[FID_INFO].size = txt_len;
+  info_txt_len = txt_len;
 
   init_starting_clusters();
 
@@ -461,19 +540,139 @@ void padded_memcpy (char *dst, char const *src, int len) {
 }
 
 
-void uf2_read_block (uint32_t block_no, uint8_t *data) {
+// render a sector of the FAT (either copy, they're the same)
+static void render_fat_sector(uint32_t fatRelativeSector, uint8_t *data) {
+  uint16_t* data16 = (uint16_t*) (void*) data;
+  uint32_t sectorFirstCluster = fatRelativeSector * FAT_ENTRIES_PER_SECTOR;
+  uint32_t firstUnusedCluster = info[FID_UF2].cluster_end + 1;
+
+  // OPTIMIZATION:
+  // Because all files are contiguous, the FAT CHAIN entries
+  // are all set to (cluster+1) to point to the next cluster.
+  // All clusters past the last used cluster of the last file
+  // are set to zero.
+  //
+  // EXCEPTIONS:
+  // 1. Clusters 0 and 1 require special handling
+  // 2. Final cluster of each file must be set to END_OF_CHAIN
+  //
+
+  // Set default FAT values first.
+  for (uint16_t i = 0; i < FAT_ENTRIES_PER_SECTOR; i++) {
+    uint32_t cluster = i + sectorFirstCluster;
+    if (cluster >= firstUnusedCluster) {
+      data16[i] = 0;
+    }
+    else {
+      data16[i] = (uint16_t) (cluster + 1);
+    }
+  }
+
+  // Exception #1: clusters 0 and 1 need special handling
+  if (fatRelativeSector == 0) {
+    data[0] = BPB_MEDIA_DESCRIPTOR_BYTE;
+    data[1] = 0xff;
+    data16[1] = FAT_END_OF_CHAIN; // cluster 1 is reserved
+  }
+
+  // Exception #2: the final cluster of each file must be set to END_OF_CHAIN
+  for (uint32_t i = 0; i < NUM_FILES; i++) {
+    uint32_t lastClusterOfFile = info[i].cluster_end;
+    if (lastClusterOfFile >= sectorFirstCluster) {
+      uint32_t idx = lastClusterOfFile - sectorFirstCluster;
+      if (idx < FAT_ENTRIES_PER_SECTOR) {
+        // that last cluster of the file is in this sector
+        data16[idx] = FAT_END_OF_CHAIN;
+      }
+    }
+  }
+}
+
+// render a root directory sector
+static void render_rootdir_sector(uint32_t dirRelativeSector, uint8_t *data) {
   memset(data, 0, BPB_SECTOR_SIZE);
+  DirEntry *d = (void*) data;                   // pointer to next free DirEntry this sector
+  int remainingEntries = DIRENTRIES_PER_SECTOR; // remaining count of DirEntries this sector
+
+  uint32_t startingFileIndex;
+
+  if ( dirRelativeSector == 0 ) {
+    // volume label is first directory entry
+    padded_memcpy(d->name, (char const*) BootBlock.VolumeLabel, 11);
+    d->attrs = 0x28;
+    d++;
+    remainingEntries--;
+
+    startingFileIndex = 0;
+  }else {
+    // -1 to account for volume label in first sector
+    startingFileIndex = DIRENTRIES_PER_SECTOR * dirRelativeSector - 1;
+  }
+
+  for ( uint32_t fileIndex = startingFileIndex;
+        remainingEntries > 0 && fileIndex < NUM_FILES; // while space remains in buffer and more files to add...
+        fileIndex++, d++ ) {
+    // WARNING -- code presumes all files take exactly one directory entry (no long file names!)
+    FileContent_t const *inf = &info[fileIndex];
+    // empty files own no clusters
+    uint32_t const startCluster = inf->size ? inf->cluster_start : 0;
+
+    padded_memcpy(d->name, inf->name, 11);
+    d->createTimeFine   = COMPILE_SECONDS_INT % 2 * 100;
+    d->createTime       = (uint16_t)COMPILE_DOS_TIME;
+    d->createDate       = (uint16_t)COMPILE_DOS_DATE;
+    d->lastAccessDate   = (uint16_t)COMPILE_DOS_DATE;
+    d->highStartCluster = (uint16_t)(startCluster >> 16);
+    d->updateTime       = (uint16_t)COMPILE_DOS_TIME;
+    d->updateDate       = (uint16_t)COMPILE_DOS_DATE;
+    d->startCluster     = (uint16_t)(startCluster & 0xFFFF);
+    d->size             = inf->size;
+  }
+}
+
+static void ghostfat_cache_add_fat_sector(uint32_t fatRelativeSector) {
+  for (uint8_t i = 0; i < ghostfat_cache.num_fat; i++) {
+    if (ghostfat_cache.fat_sector[i] == fatRelativeSector) {
+      return;
+    }
+  }
+  if (ghostfat_cache.num_fat >= GF_CACHED_FAT_SECTORS) {
+    // rendered on the fly, as before
+    return;
+  }
+  ghostfat_cache.fat_sector[ghostfat_cache.num_fat] = (uint16_t) fatRelativeSector;
+  render_fat_sector(fatRelativeSector, ghostfat_cache.fat[ghostfat_cache.num_fat]);
+  ghostfat_cache.num_fat++;
+}
+
+static void ghostfat_cache_build(void) {
+  ghostfat_cache.num_fat = 0;
+  ghostfat_cache.first_unused_cluster = info[FID_UF2].cluster_end + 1;
+  // the media byte and reserved clusters, then the end of each file
+  ghostfat_cache_add_fat_sector(0);
+  for (uint32_t i = 0; i < NUM_FILES; i++) {
+    ghostfat_cache_add_fat_sector(info[i].cluster_end / FAT_ENTRIES_PER_SECTOR);
+  }
+  render_rootdir_sector(0, ghostfat_cache.rootdir);
+}
+
+static const uint8_t * ghostfat_cache_fat_sector(uint32_t fatRelativeSector) {
+  for (uint8_t i = 0; i < ghostfat_cache.num_fat; i++) {
+    if (ghostfat_cache.fat_sector[i] == fatRelativeSector) {
+      return ghostfat_cache.fat[i];
+    }
+  }
+  return NULL;
+}
+
+void uf2_read_block (uint32_t block_no, uint8_t *data) {
   uint32_t sectionRelativeSector = block_no;
 
   if (! bs_have_checked_for_marker() ) {
-	  uint32_t found_size = bs_check_for_marker();
-	  GF_DEBUG("FOUND A SIZE MARKER!!!");
-	  GF_DEBUG_U32_LN(found_size);
-	  if (found_size) {
-	  		  info[FID_UF2].size = found_size;
-	  }
 	  // re-init these
-	  init_starting_clusters();
+	  uf2_size_slot_files();
+	  GF_DEBUG("Size marker: ");
+	  GF_DEBUG_U32_LN(info[FID_UF2].size);
   }
 
 
@@ -481,106 +680,38 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
   // GF_DEBUG("uf2_read_block "); GF_DEBUG_U32_LN(block_no);
   if ( block_no == 0 ) {
     // Request was for the Boot block
+    memset(data, 0, BPB_SECTOR_SIZE);
     memcpy(data, &BootBlock, sizeof(BootBlock));
     data[510] = 0x55;    // Always at offsets 510/511, even when BPB_SECTOR_SIZE is larger
     data[511] = 0xaa;    // Always at offsets 510/511, even when BPB_SECTOR_SIZE is larger
   }
   else if ( block_no < FS_START_ROOTDIR_SECTOR ) {
     // Request was for a FAT table sector
-
-	// GF_DEBUG_LN("Root dir");
     sectionRelativeSector -= FS_START_FAT0_SECTOR;
 
-    // second FAT is same as the first... use sectionRelativeSector to write data
+    // second FAT is same as the first
     if ( sectionRelativeSector >= BPB_SECTORS_PER_FAT ) {
       sectionRelativeSector -= BPB_SECTORS_PER_FAT;
     }
 
-    uint16_t* data16 = (uint16_t*) (void*) data;
-    uint32_t sectorFirstCluster = sectionRelativeSector * FAT_ENTRIES_PER_SECTOR;
-    uint32_t firstUnusedCluster = info[FID_UF2].cluster_end + 1;
-
-    // OPTIMIZATION:
-    // Because all files are contiguous, the FAT CHAIN entries
-    // are all set to (cluster+1) to point to the next cluster.
-    // All clusters past the last used cluster of the last file
-    // are set to zero.
-    //
-    // EXCEPTIONS:
-    // 1. Clusters 0 and 1 require special handling
-    // 2. Final cluster of each file must be set to END_OF_CHAIN
-    //
-
-    // Set default FAT values first.
-    for (uint16_t i = 0; i < FAT_ENTRIES_PER_SECTOR; i++) {
-      uint32_t cluster = i + sectorFirstCluster;
-      if (cluster >= firstUnusedCluster) {
-        data16[i] = 0;
-      }
-      else {
-        data16[i] = (uint16_t) (cluster + 1);
-      }
-    }
-
-    // Exception #1: clusters 0 and 1 need special handling
-    if (sectionRelativeSector == 0) {
-      data[0] = BPB_MEDIA_DESCRIPTOR_BYTE;
-      data[1] = 0xff;
-      data16[1] = FAT_END_OF_CHAIN; // cluster 1 is reserved
-    }
-
-    // Exception #2: the final cluster of each file must be set to END_OF_CHAIN
-    for (uint32_t i = 0; i < NUM_FILES; i++) {
-      uint32_t lastClusterOfFile = info[i].cluster_end;
-      if (lastClusterOfFile >= sectorFirstCluster) {
-        uint32_t idx = lastClusterOfFile - sectorFirstCluster;
-        if (idx < FAT_ENTRIES_PER_SECTOR) {
-          // that last cluster of the file is in this sector
-          data16[idx] = FAT_END_OF_CHAIN;
-        }
-      }
+    const uint8_t *cached = ghostfat_cache_fat_sector(sectionRelativeSector);
+    if (cached) {
+      memcpy(data, cached, BPB_SECTOR_SIZE);
+    } else if (sectionRelativeSector * FAT_ENTRIES_PER_SECTOR
+                >= ghostfat_cache.first_unused_cluster) {
+      // past the last file: all free
+      memset(data, 0, BPB_SECTOR_SIZE);
+    } else {
+      render_fat_sector(sectionRelativeSector, data);
     }
-
   }
   else if ( block_no < FS_START_CLUSTERS_SECTOR ) {
     // Request was for a (root) directory sector .. root because not supporting subdirectories (yet)
     sectionRelativeSector -= FS_START_ROOTDIR_SECTOR;
-
-    DirEntry *d = (void*) data;                   // pointer to next free DirEntry this sector
-    int remainingEntries = DIRENTRIES_PER_SECTOR; // remaining count of DirEntries this sector
-
-    uint32_t startingFileIndex;
-
     if ( sectionRelativeSector == 0 ) {
-      // volume label is first directory entry
-      padded_memcpy(d->name, (char const*) BootBlock.VolumeLabel, 11);
-      d->attrs = 0x28;
-      d++;
-      remainingEntries--;
-
-      startingFileIndex = 0;
-    }else {
-      // -1 to account for volume label in first sector
-      startingFileIndex = DIRENTRIES_PER_SECTOR * sectionRelativeSector - 1;
-    }
-
-    for ( uint32_t fileIndex = startingFileIndex;
-          remainingEntries > 0 && fileIndex < NUM_FILES; // while space remains in buffer and more files to add...
-          fileIndex++, d++ ) {
-      // WARNING -- code presumes all files take exactly one directory entry (no long file names!)
-      uint32_t const startCluster = info[fileIndex].cluster_start;
-
-      FileContent_t const *inf = &info[fileIndex];
-      padded_memcpy(d->name, inf->name, 11);
-      d->createTimeFine   = COMPILE_SECONDS_INT % 2 * 100;
-      d->createTime       = (uint16_t)COMPILE_DOS_TIME;
-      d->createDate       = (uint16_t)COMPILE_DOS_DATE;
-      d->lastAccessDate   = (uint16_t)COMPILE_DOS_DATE;
-      d->highStartCluster = (uint16_t)(startCluster >> 16);
-      d->updateTime       = (uint16_t)COMPILE_DOS_TIME;
-      d->updateDate       = (uint16_t)COMPILE_DOS_DATE;
-      d->startCluster     = (uint16_t)(startCluster & 0xFFFF);
-      d->size             = (inf->size ? inf->size : UF2_BYTE_COUNT);
+      memcpy(data, ghostfat_cache.rootdir, BPB_SECTOR_SIZE);
+    } else {
+      render_rootdir_sector(sectionRelativeSector, data);
     }
   }
   else if ( block_no < BPB_TOTAL_SECTORS ) {
@@ -593,43 +724,60 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
 
     uint32_t fileRelativeSector = sectionRelativeSector - (uint32_t)(info[fid].cluster_start-2) * BPB_SECTORS_PER_CLUSTER;
 
-    if ( fid != FID_UF2 ) {
-      // Handle all files other than CURRENT.UF2
+    int8_t slot = slot_of_file(fid);
+    if ( slot < 0 ) {
+      // Handle all files other than CURRENT.UF2 and SLOTn.UF2,
+      // copying straight from their content (XIP, for SLOTn.BIN)
       size_t fileContentStartOffset = fileRelativeSector * BPB_SECTOR_SIZE;
       size_t fileContentLength = inf->size;
+      size_t bytesToCopy = 0;
       // nothing to copy if already past the end of the file (only when >1 sector per cluster)
       if (fileContentLength > fileContentStartOffset) {
         // obviously, 2nd and later sectors should not copy data from the start
         const void * dataStart = (inf->content) + fileContentStartOffset;
         // limit number of bytes of data to be copied to remaining valid bytes
-        size_t bytesToCopy = fileContentLength - fileContentStartOffset;
+        bytesToCopy = fileContentLength - fileContentStartOffset;
         // and further limit that to a single sector at a time
         if (bytesToCopy > BPB_SECTOR_SIZE) {
           bytesToCopy = BPB_SECTOR_SIZE;
         }
         memcpy(data, dataStart, bytesToCopy);
       }
+      // only what's past the end of the file needs clearing
+      memset(data + bytesToCopy, 0, BPB_SECTOR_SIZE - bytesToCopy);
     }
     else {
-      // CURRENT.UF2: generate data on-the-fly
+      // CURRENT.UF2 or SLOTn.UF2: generate data on-the-fly
+      memset(data, 0, BPB_SECTOR_SIZE);
 
       BoardConfigPtrConst bc = boardconfig_get();
-      uint32_t start_offset = boardconfig_bin_startoffset();
-      uint32_t addr = start_offset + (fileRelativeSector * UF2_FIRMWARE_BYTES_PER_SECTOR);
+      uint32_t num_blocks = inf->size / BPB_SECTOR_SIZE;
+      // the stream as it sits in flash, over as many blocks as were
+      // uploaded, so payloads as big as the upload's (or 256)
+      uint32_t stream_size = info[FID_SLOT1_BIN + slot].size;
+      uint32_t payload = UF2_DIV_CEIL(stream_size, num_blocks ? num_blocks : 1);
+      payload = (payload + 3) & ~3UL;
+      if (payload < UF2_FIRMWARE_BYTES_PER_SECTOR) {
+        payload = UF2_FIRMWARE_BYTES_PER_SECTOR;
+      } else if (payload > UF2_MAX_PAYLOAD_SIZE) {
+        payload = UF2_MAX_PAYLOAD_SIZE;
+      }
+      uint32_t addr = slot_stream_address[slot] + (fileRelativeSector * payload);
 
       GF_DEBUG_VERBOSE("read UF2 @");
 #if GF_DEBUG_ENABLE > 1
       GF_DEBUG_U32_LN(addr);
 #endif
-      if ( (addr - start_offset) < (BOARD_FLASH_ADDR_ZERO + _flash_size) ) {
+      // nothing past the end of the file (unused clusters land here too)
+      if ( fileRelativeSector < num_blocks ) {
         UF2_Block *bl = (void*) data;
         bl->magicStart0 = UF2_MAGIC_START0;
         bl->magicStart1 = bc->bin_download.magic_start;
         bl->magicEnd = bc->bin_download.magic_end;
         bl->blockNo = fileRelativeSector;
-        bl->numBlocks = UF2_SECTOR_COUNT;
+        bl->numBlocks = num_blocks;
         bl->targetAddr = addr;
-        bl->payloadSize = UF2_FIRMWARE_BYTES_PER_SECTOR;
+        bl->payloadSize = payload;
         bl->flags = UF2_FLAG_FAMILYID;
         bl->familyID = bc->bin_download.family_id;
 
@@ -639,6 +787,9 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
     }
 
   }
+  else {
+    memset(data, 0, BPB_SECTOR_SIZE);
+  }
 }
 
 static void uf2_write_complete(void) {
@@ -647,10 +798,586 @@ static void uf2_write_complete(void) {
 	CDCWRITEFLUSH();
 
 	board_flash_flush();
+	sleep_ms(250);
 	board_reboot();
 }
 
+/*
+ * Bitstream uploads are applied in place rather than through
+ * uf2_write_complete(): marker state and CURRENT.UF2 get refreshed,
+ * write tracking is reset for the next drop, the main loop is
+ * told to (re)program the FPGA and the host that the medium changed,
+ * so it re-reads the FS instead of trusting its cache.
+ */
+static void uf2_write_state_reset(WriteState *state) {
+	memset(state, 0, sizeof(WriteState));
+	memset(&bs_write_metainfo, 0, sizeof(bs_write_metainfo));
+	board_size_written_clear();
+}
+
+static void uf2_bitstream_write_apply(WriteState *state) {
+	GF_DEBUG_LN("UF2 bitstream applied");
+	board_flash_flush();
+	uf2_write_state_reset(state);
+
+	bs_clear_size_check_flag();
+	uf2_init();
+	msc_disk_media_changed();
+
+	MainDriverState.program_attempts = 0;
+	MainDriverState.have_programmed = false;
+	MainDriverState.immediate_led_blink = true;
+}
+
+/*
+ * The meta block comes ahead of the data and says where it's
+ * going and roughly how much of it there is (bssize is the
+ * expanded size, so an upper bound for compressed uploads):
+ * get that range erased in the background, clamped to the slot.
+ */
+static void uf2_preerase_target(uint32_t start) {
+	static Bitstream_Marker_State current;
+	uint32_t end = start + bs_write_metainfo.bssize;
+	if (!bs_write_metainfo.bssize) {
+		return;
+	}
+	for (uint8_t i = 0; i < POSITION_SLOTS_NUM; i++) {
+		uint32_t slot_start = (uint32_t) FLASH_STORAGE_STARTADDRESS(i);
+		uint32_t slot_end = (uint32_t) FLASH_STORAGE_STARTADDRESS(i + 1);
+		if ((start < slot_start) || (start >= slot_end)) {
+			continue;
+		}
+		if (end > slot_end) {
+			end = slot_end;
+		}
+		// same image dropped again: board.c's compare skips
+		// it for free, erasing would just make it cost
+		if (bs_load_marker(i, &current)
+				&& current.settings.start_address == start
+				&& (current.settings.user_info.flags & BITSTREAM_FLAG_CRC32)
+				&& (bs_write_metainfo.flags & BITSTREAM_FLAG_CRC32)
+				&& current.settings.user_info.crc32 == bs_write_metainfo.crc32) {
+			return;
+		}
+		board_flash_preerase(start, end - start);
+		return;
+	}
+}
+
+/*
+ * Volatile uploads (BITSTREAM_FLAG_VOLATILE in the meta block)
+ * go to the FPGA without ever touching flash: data blocks are
+ * assembled in the claimed bitstream cache arena, placed by
+ * their offset from the meta block's target address, and the
+ * worker clocks the lot out from RAM once everything arrived.
+ */
+typedef struct uf2volatileloadstruct {
+	uint8_t * buf;
+	uint32_t base_address;
+	uint32_t size; // highest offset written
+	bool active;
+	bool dropped; // can't be done, blocks ignored
+} UF2_VolatileLoad;
+
+static UF2_VolatileLoad uf2_volatile_load = { 0 };
+
+static void uf2_volatile_cancel(void) {
+	if (uf2_volatile_load.buf != NULL) {
+		bs_cache_release();
+	}
+	memset(&uf2_volatile_load, 0, sizeof(uf2_volatile_load));
+}
+
+static void uf2_volatile_begin(uint32_t base_address) {
+	uf2_volatile_cancel();
+	uf2_raw_drop_cancel();
+	uf2_volatile_load.active = true;
+	uf2_volatile_load.base_address = base_address;
+
+	if (bs_write_metainfo.flags & BITSTREAM_FLAG_COMPRESSED_RLE) {
+		CDCWRITESTRING("Volatile bitstreams can't be compressed\r\n");
+	} else if (bs_write_metainfo.bssize > bs_cache_capacity()) {
+		CDCWRITESTRING("Volatile bitstream too big for RAM (");
+		cdc_write_dec_u32(bs_cache_capacity());
+		CDCWRITESTRING(" bytes max)\r\n");
+	} else {
+		uf2_volatile_load.buf = bs_cache_claim();
+	}
+	uf2_volatile_load.dropped = (uf2_volatile_load.buf == NULL);
+	// whatever is in the slots stays out of the way meanwhile
+	MainDriverState.have_programmed = true;
+	CDCWRITEFLUSH();
+}
+
+static void uf2_volatile_write(uint32_t address, const uint8_t *data, uint32_t len) {
+	if (uf2_volatile_load.dropped) {
+		return;
+	}
+	uint32_t offset = address - uf2_volatile_load.base_address;
+	if (address < uf2_volatile_load.base_address
+			|| (offset + len) > bs_cache_capacity()) {
+		CDCWRITESTRING("Volatile block out of range, dropping load\r\n");
+		uf2_volatile_load.dropped = true;
+		return;
+	}
+	memcpy(&uf2_volatile_load.buf[offset], data, len);
+	if ((offset + len) > uf2_volatile_load.size) {
+		uf2_volatile_load.size = offset + len;
+	}
+}
+
+/*
+ * returns false if the worker couldn't take the request yet,
+ * in which case the host should retry the last block.
+ */
+static bool uf2_volatile_program(WriteState *state) {
+	if (uf2_volatile_load.dropped || !uf2_volatile_load.size) {
+		CDCWRITESTRING("Volatile load dropped\r\n");
+		uf2_volatile_cancel();
+	} else {
+		if (!prog_worker_request_program_ram(uf2_volatile_load.buf,
+				uf2_volatile_load.size, &bs_write_metainfo,
+				ProgWorkerOriginUpload)) {
+			prog_worker_request_abort();
+			return false;
+		}
+		CDCWRITESTRING("Volatile bitstream, ");
+		cdc_write_dec_u32(uf2_volatile_load.size);
+		CDCWRITESTRING(" bytes from RAM... ");
+		// arena now belongs to the worker, which releases it
+		memset(&uf2_volatile_load, 0, sizeof(uf2_volatile_load));
+	}
+	CDCWRITEFLUSH();
+	uf2_write_state_reset(state);
+	msc_disk_media_changed();
+	MainDriverState.immediate_led_blink = true;
+	return true;
+}
+
+
+
+/*
+ * Raw bitstream drops: a plain .BIN copied onto the drive, no UF2
+ * wrapping.  Hosts write the file's clusters, the FAT and the root
+ * directory in whatever order suits them, data usually first, so
+ * until the directory entry shows up there's no telling where it
+ * goes.  Data sectors that aren't UF2 are kept in the claimed
+ * bitstream cache arena, in arrival order, FAT entries the host
+ * changed are noted (on top of the FAT we generate) and, once a
+ * .BIN entry's whole cluster chain is here, it gets programmed into
+ * the slot, 512 bytes per sector.  SLOTn* names pick the slot,
+ * anything else goes to the selected one.
+ * Writes that never add up to a .BIN (.DS_Store, stale writeback)
+ * lose the arena, and FAT changes are forgotten, once the host has
+ * been quiet for a while.
+ */
+#if BS_CACHE_SIZE_BYTES > 0
+#define RAW_DROP_MAX_SECTORS	(BS_CACHE_SIZE_BYTES / BPB_SECTOR_SIZE)
+// the file's own FAT entries, plus a sector's worth of neighbours
+// the host rewrote along with them
+#define RAW_DROP_MAX_LINKS		(RAW_DROP_MAX_SECTORS + FAT_ENTRIES_PER_SECTOR)
+// .BIN entries the host's root dir may hold, stale ones included
+#define RAW_DROP_MAX_ENTRIES	8
+// nothing written for this long: the copy is over, or never was one
+#define RAW_DROP_IDLE_MS		3000
+STATIC_ASSERT(BPB_SECTORS_PER_CLUSTER == 1); // staged by cluster, a sector each
+
+typedef struct uf2rawdropentrystruct {
+	char name[11];
+	uint16_t start_cluster;
+	uint32_t size;
+	uint16_t dir_sector; // of the root dir, where we saw it
+} UF2_RawDropEntry;
+
+typedef struct uf2rawdropstruct {
+	uint8_t * buf;
+	uint16_t num_staged;
+	uint16_t num_links;
+	uint8_t num_entries;
+	bool failed; // gave up on it, swallow the rest until it goes idle
+	uint32_t last_write_ms;
+	// the file, once one of the entries has its whole chain here
+	UF2_RawDropEntry file;
+	uint8_t slot;
+	// programming it, sector by sector as board.c takes them
+	bool committing;
+	uint16_t commit_next;
+	uint32_t commit_address;
+	UF2_RawDropEntry entries[RAW_DROP_MAX_ENTRIES];
+	uint16_t staged_cluster[RAW_DROP_MAX_SECTORS]; // of arena sector i
+	uint16_t link_cluster[RAW_DROP_MAX_LINKS];
+	uint16_t link_next[RAW_DROP_MAX_LINKS];
+	uint16_t commit_order[RAW_DROP_MAX_SECTORS]; // arena sectors, in file order
+} UF2_RawDrop;
+
+static UF2_RawDrop uf2_raw_drop = { 0 };
+
+static void uf2_raw_drop_cancel(void) {
+	if (uf2_raw_drop.buf != NULL) {
+		bs_cache_release();
+	}
+	uf2_raw_drop.buf = NULL;
+	uf2_raw_drop.num_staged = 0;
+	uf2_raw_drop.num_links = 0;
+	uf2_raw_drop.num_entries = 0;
+	uf2_raw_drop.failed = false;
+	uf2_raw_drop.committing = false;
+}
+
+static void raw_drop_report(const char *why) {
+	CDCWRITESTRING("Raw bitstream dropped: ");
+	CDCWRITESTRING(why);
+	CDCWRITESTRING("\r\n");
+	CDCWRITEFLUSH();
+}
+
+/*
+ * Lets go of the arena and says why; writes that still come in for
+ * it are ignored (rather than staged as a new drop, that could get
+ * committed with pieces missing) until the host has gone quiet.
+ */
+static void raw_drop_fail(const char *why) {
+	raw_drop_report(why);
+	uf2_raw_drop_cancel();
+	uf2_raw_drop.failed = true;
+}
+
+// what the FAT we serve says for this cluster
+static uint16_t fat_entry_generated(uint32_t cluster) {
+  if (cluster >= ghostfat_cache.first_unused_cluster) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < NUM_FILES; i++) {
+    if (info[i].size && info[i].cluster_end == cluster) {
+      return FAT_END_OF_CHAIN;
+    }
+  }
+  return (uint16_t) (cluster + 1);
+}
+
+// ... and what it says now, with the host's changes
+static uint16_t raw_drop_fat_next(uint16_t cluster) {
+	for (uint16_t i = 0; i < uf2_raw_drop.num_links; i++) {
+		if (uf2_raw_drop.link_cluster[i] == cluster) {
+			return uf2_raw_drop.link_next[i];
+		}
+	}
+	return fat_entry_generated(cluster);
+}
+
+static int32_t raw_drop_staged_index(uint16_t cluster) {
+	for (uint16_t i = 0; i < uf2_raw_drop.num_staged; i++) {
+		if (uf2_raw_drop.staged_cluster[i] == cluster) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void raw_drop_fat_written(uint32_t fatRelativeSector, const uint8_t *data) {
+	const uint16_t *entries = (const uint16_t*) (const void*) data;
+	uint32_t first = fatRelativeSector * FAT_ENTRIES_PER_SECTOR;
+	// recorded whatever comes first: hosts may allocate the chain
+	// before writing any data or a sized directory entry.  Links
+	// that never lead anywhere go when the host goes quiet
+	for (uint16_t i = 0; i < FAT_ENTRIES_PER_SECTOR; i++) {
+		uint16_t cluster = (uint16_t) (first + i);
+		if (cluster < 2) {
+			continue;
+		}
+		uint16_t l;
+		for (l = 0; l < uf2_raw_drop.num_links; l++) {
+			if (uf2_raw_drop.link_cluster[l] == cluster) {
+				break;
+			}
+		}
+		if (l < uf2_raw_drop.num_links) {
+			uf2_raw_drop.link_next[l] = entries[i];
+		} else if (entries[i] != fat_entry_generated(cluster)) {
+			if (uf2_raw_drop.num_links >= RAW_DROP_MAX_LINKS) {
+				if (uf2_raw_drop.buf != NULL) {
+					raw_drop_fail("too many FAT changes");
+				}
+				// else a chain too long to stage anyway, a UF2 copy's say
+				return;
+			}
+			uf2_raw_drop.link_cluster[l] = cluster;
+			uf2_raw_drop.link_next[l] = entries[i];
+			uf2_raw_drop.num_links++;
+		}
+	}
+}
 
+/*
+ * Whatever .BIN entries (not our own files) this root dir sector
+ * holds now replace those we had from it.  Which one is the drop
+ * is only decided once a chain is complete, see raw_drop_select().
+ */
+static void raw_drop_dir_written(uint16_t dir_sector, const uint8_t *data) {
+	uint8_t kept = 0;
+	for (uint8_t e = 0; e < uf2_raw_drop.num_entries; e++) {
+		if (uf2_raw_drop.entries[e].dir_sector != dir_sector) {
+			uf2_raw_drop.entries[kept++] = uf2_raw_drop.entries[e];
+		}
+	}
+	uf2_raw_drop.num_entries = kept;
+
+	const DirEntry *d = (const DirEntry*) (const void*) data;
+	for (uint8_t i = 0; i < DIRENTRIES_PER_SECTOR; i++, d++) {
+		if (d->name[0] == 0) {
+			break;
+		}
+		if ((uint8_t) d->name[0] == 0xE5 || (d->attrs & 0x18)
+				|| memcmp(d->ext, "BIN", 3) || !d->size
+				|| d->startCluster < 2) {
+			// deleted, label or long name part, directory, not a .BIN or empty
+			continue;
+		}
+		bool ours = false;
+		for (uint32_t f = 0; f < NUM_FILES; f++) {
+			if (!memcmp(d->name, info[f].name, 8) && !memcmp(d->ext, &info[f].name[8], 3)
+					&& d->size == info[f].size
+					&& d->startCluster == info[f].cluster_start) {
+				ours = true;
+				break;
+			}
+		}
+		if (ours || uf2_raw_drop.num_entries >= RAW_DROP_MAX_ENTRIES) {
+			continue;
+		}
+		UF2_RawDropEntry *entry = &uf2_raw_drop.entries[uf2_raw_drop.num_entries++];
+		memcpy(entry->name, d->name, 8);
+		memcpy(&entry->name[8], d->ext, 3);
+		entry->start_cluster = d->startCluster;
+		entry->size = d->size;
+		entry->dir_sector = dir_sector;
+	}
+}
+
+/*
+ * Walks the entry's chain: true, with commit_order filled in,
+ * once every one of its clusters has arrived.
+ */
+static bool raw_drop_complete(const UF2_RawDropEntry *entry) {
+	uint32_t num_clusters = UF2_DIV_CEIL(entry->size, BPB_SECTOR_SIZE);
+	uint16_t cluster = entry->start_cluster;
+	if (num_clusters > RAW_DROP_MAX_SECTORS) {
+		return false;
+	}
+	for (uint32_t i = 0; i < num_clusters; i++) {
+		int32_t idx = raw_drop_staged_index(cluster);
+		if (idx < 0) {
+			return false;
+		}
+		uf2_raw_drop.commit_order[i] = (uint16_t) idx;
+		cluster = raw_drop_fat_next(cluster);
+		if ((i + 1) < num_clusters && (cluster < 2 || cluster >= 0xFFF0)) {
+			// chain not (all) written yet
+			return false;
+		}
+	}
+	return cluster >= 0xFFF8;
+}
+
+/*
+ * The entry whose chain is all here is the one being copied: a stale
+ * .BIN the host still lists won't have its clusters staged.  Most
+ * recently written first, should two of them qualify.
+ */
+static bool raw_drop_select(void) {
+	for (uint8_t e = uf2_raw_drop.num_entries; e > 0; e--) {
+		const UF2_RawDropEntry *entry = &uf2_raw_drop.entries[e - 1];
+		if (!raw_drop_complete(entry)) {
+			continue;
+		}
+		uf2_raw_drop.file = *entry;
+		uf2_raw_drop.slot = boardconfig_selected_bitstream_slot();
+		if (!memcmp(entry->name, "SLOT", 4) && entry->name[4] >= '1'
+				&& entry->name[4] < ('1' + POSITION_SLOTS_ALLOWED)) {
+			uf2_raw_drop.slot = (uint8_t) (entry->name[4] - '1');
+		}
+		return true;
+	}
+	return false;
+}
+
+static void raw_drop_metainfo(Bitstream_MetaInfo *meta) {
+	memset(meta, 0, sizeof(Bitstream_MetaInfo));
+	meta->bssize = uf2_raw_drop.file.size;
+	for (uint8_t i = 0; i < 11; i++) {
+		if (i == 8) {
+			meta->name[meta->namelen++] = '.';
+		}
+		if (uf2_raw_drop.file.name[i] != ' ') {
+			meta->name[meta->namelen++] = uf2_raw_drop.file.name[i];
+		}
+	}
+	if (prog_worker_busy()) {
+		// the sniffer is the worker's
+		return;
+	}
+	board_crc32_start();
+	uint32_t left = uf2_raw_drop.file.size;
+	for (uint16_t i = 0; left; i++) {
+		uint32_t len = (left > BPB_SECTOR_SIZE) ? BPB_SECTOR_SIZE : left;
+		board_crc32_update(&uf2_raw_drop.buf[uf2_raw_drop.commit_order[i]
+				* BPB_SECTOR_SIZE], len);
+		left -= len;
+	}
+	meta->crc32 = board_crc32_sniff_result();
+	board_crc32_sniff_stop();
+	meta->flags |= BITSTREAM_FLAG_CRC32;
+}
+
+// as the UF2 path: 0 while flash is busy, so tinyusb comes back
+static int raw_drop_commit(WriteState *state) {
+	BoardConfigPtrConst bc = boardconfig_get();
+
+	if (!uf2_raw_drop.committing) {
+		if (!raw_drop_select()) {
+			return BPB_SECTOR_SIZE;
+		}
+		uint32_t num_clusters = UF2_DIV_CEIL(uf2_raw_drop.file.size, BPB_SECTOR_SIZE);
+		if ((num_clusters * BPB_SECTOR_SIZE) > BITSTREAM_SLOT_RESERVED_SPACE) {
+			raw_drop_fail("too big for a slot");
+			return BPB_SECTOR_SIZE;
+		}
+		CDCWRITESTRING("Raw bitstream, ");
+		cdc_write_dec_u32(uf2_raw_drop.file.size);
+		CDCWRITESTRING(" bytes, to slot ");
+		cdc_write_dec_u8_ln(uf2_raw_drop.slot + 1);
+		raw_drop_metainfo(&bs_write_metainfo);
+		uf2_raw_drop.committing = true;
+		uf2_raw_drop.commit_next = 0;
+		uf2_raw_drop.commit_address = bc->bin_position.slot_start_address[uf2_raw_drop.slot];
+		board_size_written_clear();
+		board_flash_session_start();
+		// skipped for the same image again, as for UF2
+		uf2_preerase_target(uf2_raw_drop.commit_address);
+	}
+
+	uint32_t num_clusters = UF2_DIV_CEIL(uf2_raw_drop.file.size, BPB_SECTOR_SIZE);
+	uint32_t slot_start = uf2_raw_drop.commit_address;
+	while (uf2_raw_drop.commit_next < num_clusters) {
+		uint16_t idx = uf2_raw_drop.commit_order[uf2_raw_drop.commit_next];
+		if (!board_flash_write_async(slot_start
+				+ (uf2_raw_drop.commit_next * BPB_SECTOR_SIZE),
+				&uf2_raw_drop.buf[idx * BPB_SECTOR_SIZE], BPB_SECTOR_SIZE)) {
+			return 0;
+		}
+		uf2_raw_drop.commit_next++;
+	}
+	if (board_flash_write_pending()) {
+		return 0;
+	}
+	board_flash_flush();
+
+	if (uf2_raw_drop.slot != boardconfig_selected_bitstream_slot()) {
+		boardconfig_set_bitstream_slot(uf2_raw_drop.slot);
+	}
+	if (!boardconfig_bitstream_slot_saved()) {
+		boardconfig_write();
+	}
+	// sized as the UF2 it would have been, for SLOTn.UF2
+	bs_write_marker_to_slot(uf2_raw_drop.slot,
+			UF2_DIV_CEIL(uf2_raw_drop.file.size, UF2_FIRMWARE_BYTES_PER_SECTOR),
+			uf2_raw_drop.file.size, slot_start, &bs_write_metainfo);
+	CDCWRITESTRING("New bitstream in slot ");
+	cdc_write_dec_u8(uf2_raw_drop.slot + 1);
+	CDCWRITESTRING(", programming\r\n");
+	CDCWRITEFLUSH();
+	// re-inits the drive, which lets go of the arena
+	uf2_bitstream_write_apply(state);
+	return BPB_SECTOR_SIZE;
+}
+
+/*
+ * Anything written that isn't UF2 ends up here: -1 if it's none of
+ * our business, otherwise as uf2_write_block().
+ */
+static int uf2_raw_drop_write(uint32_t block_no, const uint8_t *data,
+		WriteState *state) {
+	if (uf2_volatile_load.active || state->numWritten) {
+		// UF2 upload in progress, which has the arena or the flash
+		return -1;
+	}
+	if (block_no < FS_START_FAT0_SECTOR || block_no >= BPB_TOTAL_SECTORS) {
+		return -1;
+	}
+	uf2_raw_drop.last_write_ms = board_millis();
+	if (uf2_raw_drop.failed) {
+		// more of the one we gave up on
+		return BPB_SECTOR_SIZE;
+	}
+
+	if (block_no < FS_START_FAT1_SECTOR) {
+		// second copy is the same
+		raw_drop_fat_written(block_no - FS_START_FAT0_SECTOR, data);
+	} else if (block_no >= FS_START_ROOTDIR_SECTOR
+			&& block_no < FS_START_CLUSTERS_SECTOR) {
+		raw_drop_dir_written((uint16_t) (block_no - FS_START_ROOTDIR_SECTOR), data);
+	} else if (block_no >= FS_START_CLUSTERS_SECTOR) {
+		if (uf2_raw_drop.committing) {
+			return raw_drop_commit(state);
+		}
+		uint16_t cluster = (uint16_t) (2 + ((block_no - FS_START_CLUSTERS_SECTOR)
+				/ BPB_SECTORS_PER_CLUSTER));
+		if (uf2_raw_drop.buf == NULL) {
+			if (prog_worker_busy()) {
+				// may be streaming from the arena, come back later
+				return 0;
+			}
+			// held until it's committed, or the host goes quiet
+			uf2_raw_drop.buf = bs_cache_claim();
+		}
+		int32_t idx = raw_drop_staged_index(cluster);
+		if (idx < 0) {
+			if (uf2_raw_drop.num_staged >= RAW_DROP_MAX_SECTORS) {
+				raw_drop_fail("too big for RAM");
+				return BPB_SECTOR_SIZE;
+			}
+			idx = uf2_raw_drop.num_staged++;
+			uf2_raw_drop.staged_cluster[idx] = cluster;
+		}
+		memcpy(&uf2_raw_drop.buf[idx * BPB_SECTOR_SIZE], data, BPB_SECTOR_SIZE);
+	}
+
+	if (uf2_raw_drop.failed || !uf2_raw_drop.num_entries || uf2_raw_drop.buf == NULL) {
+		return BPB_SECTOR_SIZE;
+	}
+	return raw_drop_commit(state);
+}
+
+void uf2_task(void) {
+	if (uf2_raw_drop.committing
+			|| !(uf2_raw_drop.buf != NULL || uf2_raw_drop.num_entries
+					|| uf2_raw_drop.num_links || uf2_raw_drop.failed)) {
+		return;
+	}
+	if ((board_millis() - uf2_raw_drop.last_write_ms) > RAW_DROP_IDLE_MS) {
+		// .DS_Store and the like, or a copy that never completed:
+		// give the bitstream cache its arena back, forget stale links
+		if (uf2_raw_drop.buf != NULL) {
+			raw_drop_report("no complete .BIN arrived");
+		}
+		uf2_raw_drop_cancel();
+	}
+}
+#else
+static void uf2_raw_drop_cancel(void) {
+}
+
+static int uf2_raw_drop_write(uint32_t block_no, const uint8_t *data,
+		WriteState *state) {
+	(void) block_no;
+	(void) data;
+	(void) state;
+	return -1;
+}
+
+void uf2_task(void) {
+}
+#endif
 
 /*------------------------------------------------------------------*/
 /* Write UF2
@@ -723,7 +1450,6 @@ static void debug_dump_datablock(uint8_t *data, uint16_t len) {
 
 
 int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
-  (void) block_no;
   static bool write_is_complete = false;
   BoardConfigPtrConst bc = boardconfig_get();
   UF2_Block *bl = (void*) data;
@@ -760,6 +1486,27 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
 		  // save the meta info within
 		  memcpy(&bs_write_metainfo, &payloadmeta.info, sizeof(bs_write_metainfo));
 
+		  if (bs_write_metainfo.flags & BITSTREAM_FLAG_VOLATILE) {
+			  if (state->numWritten) {
+				  // data went to flash already, too late to divert it
+				  CDCWRITESTRING("Late volatile meta block, writing to flash\r\n");
+				  bs_write_metainfo.flags &= ~BITSTREAM_FLAG_VOLATILE;
+			  } else if (!uf2_volatile_load.active) {
+				  if (prog_worker_busy()) {
+					  // the arena may be in use by the worker: stop it
+					  // and have the host retry once it's idle
+					  prog_worker_request_abort();
+					  return 0;
+				  }
+				  uf2_volatile_begin(bl->targetAddr);
+			  }
+		  } else {
+			  uf2_volatile_cancel();
+			  if (!state->numWritten) {
+				  uf2_preerase_target(bl->targetAddr);
+			  }
+		  }
+
 
 		#ifdef UF2_WRITE_DEBUG_UF2_METAINFO_DUMP
 		  	  	  DEBUG_U32_LN(bs_write_metainfo.clock_hz);
@@ -768,6 +1515,12 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
 		#endif
 
 		state->numWritten++;
+	  } else {
+		  // may be part of a plain .BIN being copied over
+		  int raw_rv = uf2_raw_drop_write(block_no, data, state);
+		  if (raw_rv >= 0) {
+			  return raw_rv;
+		  }
 	  }
 
 
@@ -819,6 +1572,11 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
     	return -1;
     }
 
+	if (!bl->payloadSize || bl->payloadSize > UF2_MAX_PAYLOAD_SIZE) {
+		CDCWRITESTRING("Bad UF2 payload size\r\n");
+		return BPB_SECTOR_SIZE;
+	}
+
 	// ok looking good: matching/valid family ID
 	if (bl->blockNo < MAX_BLOCKS) {
 
@@ -828,7 +1586,18 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
 		if (!(state->writtenMask[pos] & mask)) {
 
 			// ok, not a dupe, do the write
-			board_flash_write(bl->targetAddr, bl->data, bl->payloadSize);
+			if (!state->numWritten) {
+				uf2_raw_drop_cancel();
+				board_flash_session_start();
+			}
+			if (uf2_volatile_load.active) {
+				uf2_volatile_write(bl->targetAddr, bl->data, bl->payloadSize);
+			} else if (!board_flash_write_async(bl->targetAddr, bl->data,
+					bl->payloadSize)) {
+				// previous sector still being written out by the
+				// main loop, tinyusb will hand us this block again
+				return 0;
+			}
 
 			// and make note of it
 			state->writtenMask[pos] |= mask;
@@ -860,6 +1629,16 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
 		return BPB_SECTOR_SIZE;
 	}
 
+	if (uf2_volatile_load.active) {
+		// nothing to flush or mark, slots are left alone
+		return uf2_volatile_program(state) ? BPB_SECTOR_SIZE : 0;
+	}
+
+	if (board_flash_write_pending()) {
+		// let the main loop finish programming before wrapping up
+		return 0;
+	}
+
 	// handling slot info write, now
 	write_is_complete = true; // don't do twice
 
@@ -871,6 +1650,9 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
 		GF_DEBUG_LN(" no name.");
 	}
 
+	// last partial sector(s) still buffered
+	board_flash_flush();
+
 	// grab this before playing with flash any further
 	uint32_t bs_start_addy = board_first_written_address();
 	uint32_t bs_size_written = board_size_written();
@@ -905,6 +1687,8 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
 			CDCWRITESTRING("Wrote UF2 to a new slot: ");
 			cdc_write_dec_u8_ln(slotidx + 1);
 			boardconfig_set_bitstream_slot(slotidx);
+		}
+		if (!boardconfig_bitstream_slot_saved()) {
 			boardconfig_write();
 		}
 		bs_write_marker_to_slot(slotidx, state->numBlocks, bs_size_written,
@@ -913,9 +1697,12 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
 		bs_write_marker(state->numBlocks, bs_size_written, bs_start_addy,
 				&bs_write_metainfo);
 	}
+	CDCWRITESTRING("New bitstream in slot ");
+	cdc_write_dec_u8(boardconfig_selected_bitstream_slot() + 1);
+	CDCWRITESTRING(", programming\r\n");
 	CDCWRITEFLUSH();
-	sleep_ms(150);
-	uf2_write_complete();
+	uf2_bitstream_write_apply(state);
+	write_is_complete = false; // ready for the next one
 
 
 
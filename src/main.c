@@ -38,6 +38,8 @@
 #include "sui/sui_handler.h"
 #include "uart_bridge.h"
 #include "io_inputs.h"
+#include "prog_worker.h"
+#include "sui/commands/fpga.h"
 
 #include "driver_state.h"
 
@@ -62,11 +64,18 @@ enum {
 
 void led_blinking_task(void);
 void cdc_task(void);
+void prog_worker_events_task(void);
+void flash_wipe_events_task(void);
 
 void run_tasks(void) {
 	tud_task(); // tinyusb device task
 	cdc_task();
 	led_blinking_task();
+	prog_worker_events_task();
+	// one erase/program per pass, so USB gets serviced in between
+	board_flash_task();
+	flash_wipe_events_task();
+	uf2_task();
 }
 
 void setup(void) {
@@ -95,6 +104,8 @@ void setup(void) {
 	}
 	fpga_init();
 	fpga_reset(true);
+	// from here on, the worker owns the FPGA
+	prog_worker_init();
 
 	io_inputs_init();
 	io_switches_init();
@@ -118,7 +129,6 @@ void setup(void) {
 /*------------- MAIN -------------*/
 int main(void) {
 	setup();
-	uint8_t attempts = 0;
 	while (1) {
 		run_tasks();
 		if (MainDriverState.clocking_manually) {
@@ -138,13 +148,13 @@ int main(void) {
 			}
 			MainDriverState.have_programmed = false;
 			fpga_external_reset_handled();
-			attempts = 0;
+			MainDriverState.program_attempts = 0;
 			CDCWRITEFLUSH();
 			continue;
 		}
 
 		run_tasks();
-		if (!MainDriverState.have_programmed) {
+		if (!MainDriverState.have_programmed && !prog_worker_busy()) {
 			if ((fpga_external_reset_applied() == false)
 					&& board_millis()
 							> (BASE_FPGA_PROG_DELAY
@@ -164,18 +174,10 @@ int main(void) {
 
 				if (bs_file_size()) {
 					DEBUG("Have bitstream, "); DEBUG_U32(bs_file_size()); DEBUG_LN(" bytes. Program...");
-					bs_program_fpga(run_tasks);
-					DEBUG_LN("Done.");
-					sleep_ms(100);
-					run_tasks();
-					if (fpga_is_programmed()) {
-						attempts = 0;
-					} else {
-						attempts++;
-						if (attempts < 3) {
-							MainDriverState.have_programmed = false;
-						}
-					}
+					prog_worker_request_program(
+							boardconfig_selected_bitstream_slot(),
+							ProgWorkerOriginAuto);
+					// retries handled in prog_worker_events_task()
 				} else {
 					DEBUG_LN("No bitstream found");
 				}
@@ -185,6 +187,69 @@ int main(void) {
 	}
 }
 
+//--------------------------------------------------------------------+
+// Programming worker events
+//--------------------------------------------------------------------+
+
+static void auto_programming_done(const ProgWorkerEvent *evt) {
+	DEBUG_LN("Done.");
+	if (evt->programmed) {
+		MainDriverState.program_attempts = 0;
+	} else if (evt->corrupt) {
+		// retrying won't fix the flash contents
+		CDCWRITESTRING("\r\nSlot ");
+		cdc_write_dec_u8(evt->slot + 1);
+		CDCWRITESTRING(" failed CRC check, not programmed\r\n");
+		CDCWRITEFLUSH();
+	} else {
+		MainDriverState.program_attempts++;
+		if (MainDriverState.program_attempts < 3) {
+			MainDriverState.have_programmed = false;
+		}
+	}
+}
+
+void prog_worker_events_task(void) {
+	ProgWorkerEvent evt;
+	while (prog_worker_poll_event(&evt)) {
+		if (evt.type != ProgWorkerEventDone) {
+			// progress and reset acks: nothing to do here for now
+			continue;
+		}
+		MainDriverState.immediate_led_blink = true;
+		if (evt.origin == ProgWorkerOriginAuto) {
+			auto_programming_done(&evt);
+		} else {
+			// shell and volatile uploads both report on the CDC
+			cmd_fpga_prog_report(&evt);
+		}
+	}
+}
+
+// slot wipes run in the background, report every quarter or so
+void flash_wipe_events_task(void) {
+	static bool wiping = false;
+	static uint8_t reported_quarter = 0;
+	static uint32_t wipe_total = 0;
+	uint32_t done, total;
+	bool pending = board_flash_wipe_progress(&done, &total);
+	if (pending && !wiping) {
+		wiping = true;
+		reported_quarter = 0;
+		wipe_total = total;
+	}
+	if (!wiping) {
+		return;
+	}
+	// an upload cuts the wipe short, so measure against the original
+	uint8_t quarter = wipe_total ? (uint8_t) ((done * 4) / wipe_total) : 4;
+	if (!pending || quarter > reported_quarter) {
+		cmd_fpga_erase_progress(done, wipe_total, !pending);
+		reported_quarter = quarter;
+	}
+	wiping = pending;
+}
+
 //--------------------------------------------------------------------+
 // Device callbacks
 //--------------------------------------------------------------------+
@@ -220,6 +285,7 @@ void tud_resume_cb(void) {
 void tud_and_blink_tasks(void) {
 	tud_task();
 	led_blinking_task();
+	prog_worker_events_task();
 	tud_task();
 }
 
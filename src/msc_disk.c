@@ -33,6 +33,11 @@
 
 
 static WriteState _wr_state = {0};
+static bool _media_changed = false;
+
+void msc_disk_media_changed(void) {
+  _media_changed = true;
+}
 
 //--------------------------------------------------------------------+
 // tinyusb callbacks
@@ -56,7 +61,12 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16
 // Invoked when received Test Unit Ready command.
 // return true allowing host to read/write this LUN e.g SD card inserted
 bool tud_msc_test_unit_ready_cb(uint8_t lun) {
-  (void) lun;
+  if (_media_changed) {
+    // once: host re-reads FAT/root dir and carries on
+    _media_changed = false;
+    tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION, 0x28, 0x00);
+    return false;
+  }
   return true;
 }
 
@@ -103,7 +113,6 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, u
 // Copy disk's data to buffer (up to bufsize) and return number of copied bytes.
 int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize) {
   (void) lun;
-  memset(buffer, 0, bufsize);
   /*
   DEBUG("read10cb lba:");
   DEBUG_U32(lba);
@@ -117,6 +126,7 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buff
 
   uint32_t count = 0;
 
+  // every sector gets filled in whole, no need to clear beforehand
   while (count < bufsize) {
     uf2_read_block(lba, buffer);
 
@@ -177,7 +187,7 @@ void tud_msc_write10_complete_cb(uint8_t lun) {
     if (_wr_state.numWritten >= _wr_state.numBlocks) {
       // DEBUG_LN("mscw done");
       #if DEBUG_SPEED_TEST
-      uint32_t const wr_byte = _wr_state.numWritten*256;
+      uint32_t const wr_byte = _wr_state.payloadTotal;
       _write_ms = esp_log_timestamp()-_write_ms;
       printf("written %u bytes in %.02f seconds.\r\n", wr_byte, _write_ms / 1000.0F);
       printf("Speed : %.02f KB/s\r\n", (wr_byte / 1000.0F) / (_write_ms / 1000.0F));
@@ -0,0 +1,85 @@
+/*
+ * prog_stats.c, part of the riffpga project
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "prog_stats.h"
+
+typedef struct progstatsstatestruct {
+	ProgStatsRun history[PROG_STATS_HISTORY_LEN];
+	volatile uint32_t num_runs;
+
+	// run in progress, only copied into history once complete
+	ProgStatsRun current;
+	bool in_run;
+	uint64_t mark_us;
+} ProgStatsState;
+
+static ProgStatsState prog_stats = { 0 };
+
+void prog_stats_run_begin(uint8_t slot, uint8_t retries) {
+	memset(&prog_stats.current, 0, sizeof(prog_stats.current));
+	prog_stats.current.slot = slot;
+	prog_stats.current.retries = retries;
+	prog_stats.in_run = true;
+	prog_stats.mark_us = time_us_64();
+}
+
+void prog_stats_phase_done(ProgStatsPhase phase) {
+	if (!prog_stats.in_run || phase >= ProgStatsPhaseNUM) {
+		return;
+	}
+	uint64_t tnow = time_us_64();
+	prog_stats.current.phase_us[phase] += (uint32_t) (tnow - prog_stats.mark_us);
+	prog_stats.mark_us = tnow;
+}
+
+void prog_stats_run_end(bool success, uint32_t bytes, bool cdone) {
+	if (!prog_stats.in_run) {
+		return;
+	}
+	prog_stats.current.success = success;
+	prog_stats.current.bytes = bytes;
+	prog_stats.current.cdone = cdone;
+	prog_stats.in_run = false;
+
+	memcpy(&prog_stats.history[prog_stats.num_runs % PROG_STATS_HISTORY_LEN],
+			&prog_stats.current, sizeof(prog_stats.current));
+	prog_stats.num_runs++;
+}
+
+uint32_t prog_stats_num_runs(void) {
+	return prog_stats.num_runs;
+}
+
+const ProgStatsRun* prog_stats_get(uint8_t idx) {
+	uint32_t num_runs = prog_stats.num_runs;
+	if (idx >= PROG_STATS_HISTORY_LEN || idx >= num_runs) {
+		return NULL;
+	}
+	return &prog_stats.history[(num_runs - 1 - idx) % PROG_STATS_HISTORY_LEN];
+}
+
+uint32_t prog_stats_stream_rate(const ProgStatsRun *run) {
+	if (!run->phase_us[ProgStatsPhaseStream]) {
+		return 0;
+	}
+	// bytes/us is MB/s
+	return (uint32_t) ((((uint64_t) run->bytes) * 100ULL)
+			/ run->phase_us[ProgStatsPhaseStream]);
+}
@@ -0,0 +1,68 @@
+/*
+ * prog_stats.h, part of the riffpga project
+ *
+ * Timing of FPGA programming runs, per phase, with a
+ * short rolling history so SPI rates and delays can be
+ * tuned from data.
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_PROG_STATS_H_
+#define SRC_PROG_STATS_H_
+
+#include "board_includes.h"
+
+#define PROG_STATS_HISTORY_LEN	8
+
+typedef enum progstatsphaseenum {
+	ProgStatsPhaseEnter = 0, /* fpga_enter_programming_mode() */
+	ProgStatsPhaseStream = 1, /* bitstream streaming loop */
+	ProgStatsPhaseExit = 2, /* fpga_exit_programming_mode() */
+	ProgStatsPhaseCDONE = 3, /* post-program CDONE check */
+	ProgStatsPhaseNUM
+} ProgStatsPhase;
+
+typedef struct progstatsrunstruct {
+	uint8_t slot;
+	uint8_t retries;
+	bool cdone;
+	bool success;
+	uint32_t bytes;
+	uint32_t phase_us[ProgStatsPhaseNUM];
+} ProgStatsRun;
+
+/*
+ * Run bracketing, done by whoever owns the programming
+ * (the worker).  Phase marks outside a begin/end pair are
+ * ignored, so bs_program_fpga_*() can always call them.
+ */
+void prog_stats_run_begin(uint8_t slot, uint8_t retries);
+// time since begin or since the previous phase was done
+void prog_stats_phase_done(ProgStatsPhase phase);
+void prog_stats_run_end(bool success, uint32_t bytes, bool cdone);
+
+// total runs recorded since boot
+uint32_t prog_stats_num_runs(void);
+
+// idx 0 is the most recent, returns NULL past what's available
+const ProgStatsRun * prog_stats_get(uint8_t idx);
+
+// bytes per stream phase, in MB/s * 100
+uint32_t prog_stats_stream_rate(const ProgStatsRun * run);
+
+#endif /* SRC_PROG_STATS_H_ */
@@ -0,0 +1,230 @@
+/*
+ * prog_worker.c, part of the riffpga project
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "board_includes.h"
+#include "pico/multicore.h"
+#include "pico/util/queue.h"
+#include "prog_worker.h"
+#include "bitstream.h"
+#include "fpga.h"
+#include "prog_stats.h"
+#include "bs_cache.h"
+#include "driver_state.h"
+#include "debug.h"
+
+/*
+ * Requests and events go through queue_t rather than the raw
+ * SIO FIFO: flash_safe_execute() locks core 1 out using that
+ * FIFO, and its handler would swallow anything else sent there.
+ */
+#define PROG_WORKER_REQUEST_QUEUE_LEN	4
+#define PROG_WORKER_EVENT_QUEUE_LEN		8
+
+// chunks between progress events
+#define PROG_WORKER_PROGRESS_EVERY		16
+
+typedef struct progworkerstatestruct {
+	queue_t requests;
+	queue_t events;
+	volatile bool busy;
+	bool is_init;
+	uint8_t slot;
+	uint8_t origin;
+	uint16_t chunk_count;
+} ProgWorkerState;
+
+static ProgWorkerState prog_worker_state = { 0 };
+
+static void prog_worker_post_event(ProgWorkerEvent * evt, bool must_deliver) {
+	if (must_deliver) {
+		queue_add_blocking(&prog_worker_state.events, evt);
+	} else {
+		// progress is informational, drop it if core 0 is behind
+		queue_try_add(&prog_worker_state.events, evt);
+	}
+}
+
+static void prog_worker_progress_cb(void) {
+	prog_worker_state.chunk_count++;
+	if (prog_worker_state.chunk_count < PROG_WORKER_PROGRESS_EVERY) {
+		return;
+	}
+	prog_worker_state.chunk_count = 0;
+
+	ProgWorkerEvent evt = { 0 };
+	evt.type = ProgWorkerEventProgress;
+	evt.slot = prog_worker_state.slot;
+	evt.origin = prog_worker_state.origin;
+	evt.bytes = bs_program_progress();
+	prog_worker_post_event(&evt, false);
+}
+
+static void prog_worker_program(const ProgWorkerRequest * req) {
+	ProgWorkerEvent evt = { 0 };
+
+	prog_worker_state.slot = req->slot;
+	prog_worker_state.origin = req->origin;
+	prog_worker_state.chunk_count = 0;
+
+	prog_stats_run_begin(req->slot, req->retries);
+	uint64_t tstart = time_us_64();
+	if (req->type == ProgWorkerRequestProgramRAM) {
+		evt.success = bs_program_fpga_ram(req->src, req->len, &req->info,
+				prog_worker_progress_cb);
+		bs_cache_release();
+	} else {
+		evt.success = bs_program_fpga_slot(req->slot, prog_worker_progress_cb);
+	}
+	evt.elapsed_us = (uint32_t) (time_us_64() - tstart);
+	evt.bytes = bs_program_progress();
+	evt.corrupt = bs_program_crc_failed();
+	evt.aborted = (evt.success == false) && bs_program_aborted() && !evt.corrupt;
+
+	evt.programmed = fpga_wait_programmed();
+	prog_stats_phase_done(ProgStatsPhaseCDONE);
+	prog_stats_run_end(evt.success, evt.bytes, evt.programmed);
+
+	evt.type = ProgWorkerEventDone;
+	evt.slot = req->slot;
+	evt.origin = req->origin;
+	prog_worker_post_event(&evt, true);
+}
+
+static void prog_worker_core1_main(void) {
+
+	// let core 0 park us while it erases/programs flash
+	flash_safe_execute_core_init();
+
+	while (1) {
+		ProgWorkerRequest req;
+		queue_remove_blocking(&prog_worker_state.requests, &req);
+
+		switch (req.type) {
+		case ProgWorkerRequestProgram:
+		case ProgWorkerRequestProgramRAM:
+			prog_worker_program(&req);
+			break;
+
+		case ProgWorkerRequestReset:
+		case ProgWorkerRequestRelease:
+		{
+			ProgWorkerEvent evt = { 0 };
+			fpga_reset(req.type == ProgWorkerRequestReset);
+			evt.type = ProgWorkerEventResetDone;
+			evt.origin = req.origin;
+			evt.success = true;
+			prog_worker_post_event(&evt, true);
+		}
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+void prog_worker_init(void) {
+	if (prog_worker_state.is_init) {
+		return;
+	}
+	queue_init(&prog_worker_state.requests, sizeof(ProgWorkerRequest),
+			PROG_WORKER_REQUEST_QUEUE_LEN);
+	queue_init(&prog_worker_state.events, sizeof(ProgWorkerEvent),
+			PROG_WORKER_EVENT_QUEUE_LEN);
+	prog_worker_state.busy = false;
+	prog_worker_state.is_init = true;
+	multicore_launch_core1(prog_worker_core1_main);
+}
+
+bool prog_worker_busy(void) {
+	return prog_worker_state.busy;
+}
+
+bool prog_worker_request_program(uint8_t slot, ProgWorkerOrigin origin) {
+	if (prog_worker_state.busy) {
+		return false;
+	}
+	ProgWorkerRequest req = { 0 };
+	req.type = ProgWorkerRequestProgram;
+	req.slot = slot;
+	req.origin = origin;
+	if (origin == ProgWorkerOriginAuto) {
+		req.retries = MainDriverState.program_attempts;
+	}
+
+	// nothing in flight, so a fresh start: aborts from here on
+	// apply to this request, even if it's still in the queue
+	bs_program_abort_clear();
+	prog_worker_state.busy = true;
+	if (!queue_try_add(&prog_worker_state.requests, &req)) {
+		prog_worker_state.busy = false;
+		return false;
+	}
+	return true;
+}
+
+bool prog_worker_request_program_ram(const uint8_t * src, uint32_t len,
+		const Bitstream_MetaInfo * info, ProgWorkerOrigin origin) {
+	if (prog_worker_state.busy) {
+		return false;
+	}
+	ProgWorkerRequest req = { 0 };
+	req.type = ProgWorkerRequestProgramRAM;
+	req.slot = PROG_WORKER_SLOT_VOLATILE;
+	req.origin = origin;
+	req.src = src;
+	req.len = len;
+	memcpy(&req.info, info, sizeof(Bitstream_MetaInfo));
+
+	// nothing in flight, so a fresh start: aborts from here on
+	// apply to this request, even if it's still in the queue
+	bs_program_abort_clear();
+	prog_worker_state.busy = true;
+	if (!queue_try_add(&prog_worker_state.requests, &req)) {
+		prog_worker_state.busy = false;
+		return false;
+	}
+	return true;
+}
+
+bool prog_worker_request_reset(bool in_reset, ProgWorkerOrigin origin) {
+	ProgWorkerRequest req = { 0 };
+	req.type = in_reset ? ProgWorkerRequestReset : ProgWorkerRequestRelease;
+	req.origin = origin;
+	return queue_try_add(&prog_worker_state.requests, &req);
+}
+
+void prog_worker_request_abort(void) {
+	// the worker is busy streaming and not looking at its
+	// queue, so this one is a flag it checks between chunks
+	if (prog_worker_state.busy) {
+		bs_program_abort();
+	}
+}
+
+bool prog_worker_poll_event(ProgWorkerEvent * evt) {
+	if (!queue_try_remove(&prog_worker_state.events, evt)) {
+		return false;
+	}
+	if (evt->type == ProgWorkerEventDone) {
+		prog_worker_state.busy = false;
+	}
+	return true;
+}
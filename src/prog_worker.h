@@ -0,0 +1,104 @@
+/*
+ * prog_worker.h, part of the riffpga project
+ *
+ * FPGA programming worker, running on core 1 so that
+ * core 0 can keep servicing USB (MSC and CDC) while
+ * bitstreams are being clocked in.
+ *
+ * Core 0 posts requests (program slot N, reset/release, abort)
+ * and picks up events (progress, done) from its main loop.
+ * Once launched, the worker owns the CRAM transport, the
+ * FPGA reset line and CDONE sampling.
+ *
+ *      Author: Pat Deegan
+ *    Copyright (C) 2025 Pat Deegan, https://psychogenic.com
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_PROG_WORKER_H_
+#define SRC_PROG_WORKER_H_
+
+#include "board_includes.h"
+#include "bitstream.h"
+
+typedef enum progworkerrequestenum {
+	ProgWorkerRequestProgram = 1,
+	ProgWorkerRequestReset = 2,
+	ProgWorkerRequestRelease = 3,
+	ProgWorkerRequestProgramRAM = 4
+} ProgWorkerRequestType;
+
+// slot reported for images programmed straight from RAM
+#define PROG_WORKER_SLOT_VOLATILE	0xff
+
+typedef enum progworkereventenum {
+	ProgWorkerEventProgress = 1,
+	ProgWorkerEventDone = 2,
+	ProgWorkerEventResetDone = 3
+} ProgWorkerEventType;
+
+// who asked, echoed back in the events
+typedef enum progworkeroriginenum {
+	ProgWorkerOriginAuto = 0,
+	ProgWorkerOriginShell = 1,
+	ProgWorkerOriginUpload = 2
+} ProgWorkerOrigin;
+
+typedef struct progworkerrequeststruct {
+	uint8_t type;
+	uint8_t slot;
+	uint8_t origin;
+	uint8_t retries;
+	// ProgWorkerRequestProgramRAM only
+	const uint8_t * src;
+	uint32_t len;
+	Bitstream_MetaInfo info; // auto-clock and CRC32
+} ProgWorkerRequest;
+
+typedef struct progworkereventstruct {
+	uint8_t type;
+	uint8_t slot;
+	uint8_t origin;
+	bool success; /* bitstream fully clocked in */
+	bool programmed; /* fpga_is_programmed() once settled */
+	bool aborted;
+	bool corrupt; /* stream didn't match the slot's or image's CRC32 */
+	uint32_t bytes;
+	uint32_t elapsed_us;
+} ProgWorkerEvent;
+
+// launches core 1, call once fpga_init() is done
+void prog_worker_init(void);
+
+// true from the time a program request is posted
+// until its done event has been polled
+bool prog_worker_busy(void);
+
+// these return false if the request couldn't be queued
+// (or, for programming, if the worker is already busy)
+bool prog_worker_request_program(uint8_t slot, ProgWorkerOrigin origin);
+bool prog_worker_request_reset(bool in_reset, ProgWorkerOrigin origin);
+// src must be a bs_cache_claim()ed arena, the worker
+// releases it once the image is clocked in
+bool prog_worker_request_program_ram(const uint8_t * src, uint32_t len,
+		const Bitstream_MetaInfo * info, ProgWorkerOrigin origin);
+
+// stops programming in progress, FPGA left in reset
+void prog_worker_request_abort(void);
+
+// core 0 side: returns true and fills evt if one was pending
+bool prog_worker_poll_event(ProgWorkerEvent * evt);
+
+#endif /* SRC_PROG_WORKER_H_ */
@@ -104,9 +104,16 @@ void cmd_select_active_slot(SUIInteractionFunctions *funcs) {
 	cdc_write_dec_u8(slotidx + 1);
 	CDCWRITESTRING(" activated (marker @ 0x");
 	cdc_write_u32(boardconfig_bs_marker_address_for(slotidx));
-	CDCWRITESTRING(")\r\n\r\n");
-	boardconfig_write();
+	CDCWRITESTRING(")\r\n");
+	if (!boardconfig_bitstream_slot_saved()) {
+		// no flash rewrite just for a switch, 'save' persists it
+		CDCWRITESTRING("Use 'save' to keep this slot across reboots.\r\n");
+	}
+	CDCWRITESTRING("\r\n");
 	bs_clear_size_check_flag();
+	// CURRENT.UF2 now reads from this slot
+	uf2_init();
+	msc_disk_media_changed();
 
 	uint32_t bs_size = bs_check_for_marker();
 	if (bs_size) {
@@ -120,7 +127,7 @@ void cmd_select_active_slot(SUIInteractionFunctions *funcs) {
 		cmd_fpga_prog(funcs);
 	} else {
 		CDCWRITESTRING("No bitstream present in slot.\r\n");
-		fpga_reset(true);
+		prog_worker_request_reset(true, ProgWorkerOriginShell);
 	}
 
 }
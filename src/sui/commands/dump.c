@@ -21,9 +21,13 @@
 
 #include "sui/commands/dump.h"
 #include "sui/commands/io.h"
+#include "sui/commands/fpga.h"
 #include "board_config_defaults.h"
 #include "cdc_interface.h"
 #include "bitstream.h"
+#include "bs_cache.h"
+#include "../../board.h"
+#include "../../fpga.h"
 
 static void dump_clocks(BoardConfigPtrConst bc, SUIInteractionFunctions *funcs) {
 
@@ -74,7 +78,34 @@ static void dump_cram_conf(BoardConfigPtrConst bc,
 	CDCWRITESTRING(" MOSI: ");
 	cdc_write_dec_u8(bc->fpga_cram.spi.pin_mosi);
 	CDCWRITESTRING(" RATE: ");
-	cdc_write_dec_u32_ln(bc->fpga_cram.spi.rate);
+	cdc_write_dec_u32(bc->fpga_cram.spi.rate);
+	if (fpga_cram_transport() == CRAMTransportPIO) {
+		CDCWRITESTRING(" (PIO)\r\n");
+	} else if (bc->fpga_cram.transport == CRAMTransportPIO) {
+		CDCWRITESTRING(" (SPI, PIO unavailable)\r\n");
+	} else {
+		CDCWRITESTRING(" (SPI)\r\n");
+	}
+	CDCWRITEFLUSH();
+
+	const FPGATimingProfile *timing = boardconfig_fpga_timing();
+	CDCWRITESTRING("\tTiming: ");
+	if (timing->family == FPGAFamilyICE40) {
+		CDCWRITESTRING("iCE40");
+	} else if (timing->family == FPGAFamilyUnset) {
+		CDCWRITESTRING("legacy");
+	} else {
+		CDCWRITESTRING("generic");
+	}
+	CDCWRITESTRING(", hold ");
+	cdc_write_dec_u32(timing->reset_hold_us);
+	CDCWRITESTRING("us, release ");
+	cdc_write_dec_u32(timing->release_wait_us);
+	CDCWRITESTRING("us, settle ");
+	cdc_write_dec_u32(timing->reset_settle_us);
+	CDCWRITESTRING("us, cdone max ");
+	cdc_write_dec_u32(timing->cdone_timeout_us);
+	CDCWRITESTRING("us\r\n");
 	CDCWRITEFLUSH();
 }
 static void dump_uart_conf(BoardConfigPtrConst bc,
@@ -262,7 +293,69 @@ static void dump_bitstream_info(BoardConfigPtrConst bc,
 
 		CDCWRITESTRING(", but no valid stream present.\r\n");
 	}
+	if (!boardconfig_bitstream_slot_saved()) {
+		CDCWRITESTRING(" (slot selection not saved)\r\n");
+	}
+
+	if (!bs_cache_capacity()) {
+		return;
+	}
+	CDCWRITESTRING(" RAM cache (");
+	cdc_write_dec_u32(bs_cache_capacity());
+	CDCWRITESTRING(" bytes):");
+	bool have_entries = false;
+	for (uint8_t i = 0; i < BS_CACHE_MAX_ENTRIES; i++) {
+		const BS_Cache_Entry *e = bs_cache_entry(i);
+		if (e == NULL) {
+			continue;
+		}
+		have_entries = true;
+		CDCWRITESTRING(" [0x");
+		cdc_write_u32(e->key.start_address);
+		CDCWRITESTRING(", ");
+		cdc_write_dec_u32(e->key.stream_size);
+		CDCWRITESTRING(" bytes, ");
+		cdc_write_dec_u32(e->hits);
+		CDCWRITESTRING(" hits]");
+	}
+	if (!have_entries) {
+		CDCWRITESTRING(" empty");
+	}
+	CDCWRITESTRING("\r\n");
+	CDCWRITEFLUSH();
+}
+static void dump_flash_stats_for(const char *label, const BoardFlashStats *fs,
+		SUIInteractionFunctions *funcs) {
+	CDCWRITESTRING(label);
+	cdc_write_dec_u32(fs->erases);
+	CDCWRITESTRING(" erases, ");
+	cdc_write_dec_u32(fs->block_erases);
+	CDCWRITESTRING(" 64k erases (");
+	cdc_write_dec_u32(fs->erases_skipped);
+	CDCWRITESTRING(" avoided), ");
+	cdc_write_dec_u32(fs->programs);
+	CDCWRITESTRING(" programs, ");
+	cdc_write_dec_u32(fs->bytes_programmed);
+	CDCWRITESTRING(" bytes, ");
+	cdc_write_dec_u32(fs->blocks_identical);
+	CDCWRITESTRING(" identical blocks skipped\r\n    ");
+	cdc_write_dec_u32(fs->double_writes);
+	CDCWRITESTRING(" double writes, ");
+	cdc_write_dec_u32(fs->exec_us_total / 1000);
+	CDCWRITESTRING(" ms in flash ops (max ");
+	cdc_write_dec_u32(fs->exec_us_max);
+	CDCWRITESTRING(" us)\r\n");
+	CDCWRITEFLUSH();
+}
+
+static void dump_flash_stats(SUIInteractionFunctions *funcs) {
+	dump_flash_stats_for(" Flash since boot: ", board_flash_stats(), funcs);
+	if (board_flash_session_stats()->sessions) {
+		dump_flash_stats_for(" Flash last upload: ", board_flash_session_stats(),
+				funcs);
+	}
 }
+
 void cmd_dump_state(SUIInteractionFunctions *funcs) {
 
 	BoardConfigPtrConst bc = boardconfig_get();
@@ -302,21 +395,66 @@ void cmd_dump_state(SUIInteractionFunctions *funcs) {
 		CDCWRITESTRING(" Project bitstream: ");
 		cdc_write_dec_u32(bsmark->settings.size);
 		CDCWRITESTRING(" bytes @ 0x");
-		cdc_write_u32_ln(bsmark->settings.start_address);
+		cdc_write_u32(bsmark->settings.start_address);
+		if (bs_is_compressed()) {
+			CDCWRITESTRING(" (RLE, ");
+			cdc_write_dec_u32(bs_stream_size());
+			CDCWRITESTRING(" expanded)");
+		}
+		CDCWRITESTRING("\r\n");
 	}
 	funcs->wait();
 
 	dump_gp_inputs(bc, funcs);
 
 	dump_bitstream_info(bc, funcs);
+	dump_flash_stats(funcs);
 
 	CDCWRITESTRING("\r\n");
 	dump_fpga_resetprog_state(bc, funcs);
+	cmd_fpga_prog_stats(funcs);
 
 	CDCWRITESTRING(footer);
 
 }
 
+static void dump_flash_stats_raw(const char *label, const BoardFlashStats *fs,
+		SUIInteractionFunctions *funcs) {
+	CDCWRITESTRING(label);
+	CDCWRITESTRING(" erases=");
+	cdc_write_dec_u32(fs->erases);
+	CDCWRITESTRING(" block_erases=");
+	cdc_write_dec_u32(fs->block_erases);
+	CDCWRITESTRING(" erases_skipped=");
+	cdc_write_dec_u32(fs->erases_skipped);
+	CDCWRITESTRING(" blocks_identical=");
+	cdc_write_dec_u32(fs->blocks_identical);
+	CDCWRITESTRING(" programs=");
+	cdc_write_dec_u32(fs->programs);
+	CDCWRITESTRING(" bytes_programmed=");
+	cdc_write_dec_u32(fs->bytes_programmed);
+	CDCWRITESTRING(" double_writes=");
+	cdc_write_dec_u32(fs->double_writes);
+	CDCWRITESTRING(" exec_us_total=");
+	cdc_write_dec_u32(fs->exec_us_total);
+	CDCWRITESTRING(" exec_us_max=");
+	cdc_write_dec_u32(fs->exec_us_max);
+	CDCWRITESTRING(" sessions=");
+	cdc_write_dec_u32(fs->sessions);
+	CDCWRITESTRING("\r\n");
+	CDCWRITEFLUSH();
+}
+
+/*
+ * one line each, key=value pairs, for scripts that want to
+ * log flash behaviour across uploads
+ */
+void cmd_dump_flash_stats(SUIInteractionFunctions *funcs) {
+	CDCWRITESTRING("\r\n");
+	dump_flash_stats_raw("flashstats boot", board_flash_stats(), funcs);
+	dump_flash_stats_raw("flashstats session", board_flash_session_stats(), funcs);
+}
+
 void cmd_dump_raw_config(SUIInteractionFunctions *funcs) {
 
 	BoardConfigPtrConst bc = boardconfig_get();
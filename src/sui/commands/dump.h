@@ -26,5 +26,6 @@
 void cmd_dump_state(SUIInteractionFunctions * funcs);
 void cmd_dump_raw_config(SUIInteractionFunctions * funcs);
 void cmd_dump_raw_slot(SUIInteractionFunctions *funcs);
+void cmd_dump_flash_stats(SUIInteractionFunctions *funcs);
 
 #endif /* SUI_COMMANDS_DUMP_H_ */
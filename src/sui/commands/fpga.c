@@ -25,38 +25,98 @@
 #include "../../fpga.h"
 #include "../../board.h"
 #include "bitstream.h"
+#include "prog_stats.h"
 
 void cmd_fpga_erase(SUIInteractionFunctions *funcs) {
 
 	CDCWRITESTRING("\r\n Erasing FPGA bitstreams\r\n");
+	prog_worker_request_abort();
 	bs_erase_all();
 
 	board_flash_pages_erased_clear();
 	bs_init();
-	fpga_reset(true);
+	// the SLOTn.UF2 files, and CURRENT.UF2, are all empty now
+	uf2_init();
+	msc_disk_media_changed();
+	prog_worker_request_reset(true, ProgWorkerOriginShell);
+	CDCWRITESTRING(" Slots emptied, blanking flash in the background\r\n");
 
 }
 
+void cmd_fpga_erase_progress(uint32_t done, uint32_t total, bool finished) {
+	CDCWRITESTRING("\r\n Slot wipe: ");
+	cdc_write_dec_u32(done / 1024);
+	CDCWRITESTRING("k/");
+	cdc_write_dec_u32(total / 1024);
+	CDCWRITESTRING("k");
+	if (finished) {
+		CDCWRITESTRING((done < total) ? ", stopped by upload" : ", done");
+	}
+	CDCWRITESTRING("\r\n");
+	CDCWRITEFLUSH();
+}
+
 void cmd_fpga_reset(SUIInteractionFunctions *funcs) {
 	CDCWRITESTRING("\r\n Toggle FPGA reset, now: ");
+	if (prog_worker_busy()) {
+		CDCWRITESTRING("busy programming, try again.");
+		return;
+	}
 	if (fpga_is_in_reset() == false) {
-		fpga_reset(true);
+		prog_worker_request_reset(true, ProgWorkerOriginShell);
 		CDCWRITESTRING("in RESET.");
 	} else {
-		fpga_reset(false);
+		prog_worker_request_reset(false, ProgWorkerOriginShell);
 		CDCWRITESTRING("enabled (not reset).");
 	}
 
 }
 void cmd_fpga_prog(SUIInteractionFunctions *funcs) {
 
+	CDCWRITESTRING("\r\nProgramming FPGA...");
+	if (!prog_worker_request_program(boardconfig_selected_bitstream_slot(),
+			ProgWorkerOriginShell)) {
+		CDCWRITESTRING("busy, try again\r\n");
+	}
+	// the rest is reported by cmd_fpga_prog_report(), when done
+}
+
+void cmd_fpga_prog_report(const ProgWorkerEvent *evt) {
+
 	BoardConfigPtrConst bc = boardconfig_get();
 
-	CDCWRITESTRING("\r\nProgramming FPGA...");
-	if (bs_program_fpga(funcs->wait) == false) {
-		CDCWRITESTRING("Failed to prog?\r\n");
+	if (evt->success == false) {
+		if (evt->aborted) {
+			CDCWRITESTRING("aborted.\r\n");
+		} else if (evt->corrupt && evt->slot == PROG_WORKER_SLOT_VOLATILE) {
+			CDCWRITESTRING("CRC mismatch, upload is corrupt\r\n");
+		} else if (evt->corrupt) {
+			CDCWRITESTRING("CRC mismatch, slot is corrupt\r\n");
+		} else {
+			CDCWRITESTRING("Failed to prog?\r\n");
+		}
 	} else {
+		uint32_t elapsed_us = evt->elapsed_us;
 		CDCWRITESTRING("done!\r\n");
+		CDCWRITESTRING(" ");
+		cdc_write_dec_u32(evt->bytes);
+		CDCWRITESTRING(" bytes in ");
+		cdc_write_dec_u32(elapsed_us);
+		CDCWRITESTRING(" us (");
+		if (elapsed_us) {
+			cdc_write_dec_u32((uint32_t) ((((uint64_t) evt->bytes) * 1000000ULL) / elapsed_us));
+		} else {
+			CDCWRITECHAR('?');
+		}
+		CDCWRITESTRING(" bytes/s)");
+		if (evt->slot == PROG_WORKER_SLOT_VOLATILE) {
+			CDCWRITESTRING(" from RAM");
+		} else if (bs_is_compressed()) {
+			CDCWRITESTRING(" from ");
+			cdc_write_dec_u32(bs_file_size());
+			CDCWRITESTRING(" compressed");
+		}
+		CDCWRITESTRING("\r\n");
 	}
 
 	CDCWRITESTRING("cdone is: ");
@@ -69,5 +129,109 @@ void cmd_fpga_prog(SUIInteractionFunctions *funcs) {
 #else
 	CDCWRITESTRING("n/a\r\n");
 #endif
+	CDCWRITEFLUSH();
+
+}
 
+void cmd_fpga_verify(SUIInteractionFunctions *funcs) {
+	CDCWRITESTRING("\r\n Verifying bitstream slots\r\n");
+	if (prog_worker_busy()) {
+		// the sniffer is busy checking that one
+		CDCWRITESTRING(" busy programming, try again.\r\n");
+		return;
+	}
+	for (uint8_t i = 0; i < POSITION_SLOTS_ALLOWED; i++) {
+		uint32_t crc = 0;
+		uint64_t tstart = time_us_64();
+		BS_VerifyResult res = bs_verify_slot(i, &crc);
+		uint32_t elapsed_us = (uint32_t) (time_us_64() - tstart);
+
+		CDCWRITESTRING("  slot ");
+		cdc_write_dec_u8(i + 1);
+		CDCWRITESTRING(": ");
+		switch (res) {
+		case BSVerifyEmpty:
+			CDCWRITESTRING("empty\r\n");
+			CDCWRITEFLUSH();
+			continue;
+		case BSVerifyNoCRC:
+			CDCWRITESTRING("no CRC recorded");
+			break;
+		case BSVerifyOK:
+			CDCWRITESTRING("OK");
+			break;
+		case BSVerifyCorrupt:
+			CDCWRITESTRING("CORRUPT");
+			break;
+		}
+		CDCWRITESTRING(" (crc32 ");
+		cdc_write_u32(crc);
+		CDCWRITESTRING(", ");
+		cdc_write_dec_u32(elapsed_us);
+		CDCWRITESTRING("us)\r\n");
+		CDCWRITEFLUSH();
+	}
+}
+
+static void write_phase_us(const char * name, uint32_t v) {
+	CDCWRITESTRING(name);
+	cdc_write_dec_u32(v);
+	CDCWRITESTRING("us");
+}
+
+void cmd_fpga_prog_stats(SUIInteractionFunctions *funcs) {
+
+	CDCWRITESTRING("\r\n Programming runs: ");
+	cdc_write_dec_u32_ln(prog_stats_num_runs());
+
+	for (uint8_t i = 0; i < PROG_STATS_HISTORY_LEN; i++) {
+		const ProgStatsRun *run = prog_stats_get(i);
+		if (run == NULL) {
+			break;
+		}
+		uint32_t total_us = 0;
+		for (uint8_t p = 0; p < ProgStatsPhaseNUM; p++) {
+			total_us += run->phase_us[p];
+		}
+
+		if (run->slot == PROG_WORKER_SLOT_VOLATILE) {
+			CDCWRITESTRING("  RAM: ");
+		} else {
+			CDCWRITESTRING("  slot ");
+			cdc_write_dec_u8(run->slot + 1);
+			CDCWRITESTRING(": ");
+		}
+		cdc_write_dec_u32(run->bytes);
+		CDCWRITESTRING(" bytes, ");
+		if (!run->success) {
+			CDCWRITESTRING("FAILED, ");
+		}
+		CDCWRITEFLUSH();
+		write_phase_us("enter ", run->phase_us[ProgStatsPhaseEnter]);
+		write_phase_us(" stream ", run->phase_us[ProgStatsPhaseStream]);
+		write_phase_us(" exit ", run->phase_us[ProgStatsPhaseExit]);
+		write_phase_us(" cdone ", run->phase_us[ProgStatsPhaseCDONE]);
+		write_phase_us(" (total ", total_us);
+		CDCWRITESTRING(")\r\n");
+		CDCWRITEFLUSH();
+
+		uint32_t rate = prog_stats_stream_rate(run);
+		CDCWRITESTRING("\t");
+		cdc_write_dec_u32(rate / 100);
+		CDCWRITECHAR('.');
+		if ((rate % 100) < 10) {
+			CDCWRITECHAR('0');
+		}
+		cdc_write_dec_u32(rate % 100);
+		CDCWRITESTRING(" MB/s, CDONE ");
+		if (run->cdone) {
+			CDCWRITESTRING("OK");
+		} else {
+			CDCWRITESTRING("not set");
+		}
+		CDCWRITESTRING(", retries ");
+		cdc_write_dec_u8_ln(run->retries);
+		CDCWRITEFLUSH();
+		funcs->wait();
+	}
 }
@@ -23,9 +23,23 @@
 #define SUI_COMMANDS_FPGA_H_
 
 #include "sui/sui_util.h"
+#include "prog_worker.h"
 
 void cmd_fpga_erase(SUIInteractionFunctions * funcs);
+// slot wipe progress, from the main loop.  Finished short
+// of total means an upload stopped it.
+void cmd_fpga_erase_progress(uint32_t done, uint32_t total, bool finished);
 void cmd_fpga_reset(SUIInteractionFunctions * funcs);
 void cmd_fpga_prog(SUIInteractionFunctions * funcs) ;
 
+// programming is done by the worker, this reports
+// its completion for shell originated requests
+void cmd_fpga_prog_report(const ProgWorkerEvent * evt);
+
+// CRC32 check of all slots against their markers
+void cmd_fpga_verify(SUIInteractionFunctions * funcs);
+
+// timing history of the last few programming runs
+void cmd_fpga_prog_stats(SUIInteractionFunctions * funcs);
+
 #endif /* SUI_COMMANDS_FPGA_H_ */
@@ -111,6 +111,20 @@ static CommandInfo commands[] = {
 				.needs_confirmation = true,
 				.cb = cmd_fpga_erase
 		},
+		{
+				.command = "verify",
+				.help = "Check bitstream slots against their CRC",
+				.hotkey = 'K',
+				.needs_confirmation = false,
+				.cb = cmd_fpga_verify
+		},
+		{
+				.command = "progstats",
+				.help = "FPGA programming timing history",
+				.hotkey = 'G',
+				.needs_confirmation = false,
+				.cb = cmd_fpga_prog_stats
+		},
 
 		{
 				.command = "sysclock",
@@ -175,6 +189,13 @@ static CommandInfo commands[] = {
 				.needs_confirmation = true,
 				.cb = cmd_factory_reset_config
 		},
+		{
+				.command = "flashstats",
+				.help = "Flash I/O counters, key=value",
+				.hotkey = 'L',
+				.needs_confirmation = false,
+				.cb = cmd_dump_flash_stats
+		},
 #ifdef DEBUG_OUTPUT_ENABLED
 		{
 				.command = "rawconf",
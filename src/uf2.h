@@ -68,6 +68,8 @@ SOFTWARE.
 #define UF2_FLAG_FAMILYID   0x00002000
 
 #define MAX_BLOCKS (CFG_UF2_FLASH_SIZE / 256 + 100)
+// what a block can carry, any size up to this and unaligned is fine
+#define UF2_MAX_PAYLOAD_SIZE	476
 
 #define BITSTREAM_NAME_MAXLEN		23
 typedef struct {
@@ -94,7 +96,7 @@ typedef struct {
     uint32_t familyID;
 
     // raw data;
-    uint8_t data[476];
+    uint8_t data[UF2_MAX_PAYLOAD_SIZE];
 
     // store magic also at the end to limit damage from partial block reads
     uint32_t magicEnd;
@@ -104,5 +106,11 @@ typedef struct {
 void uf2_init(void);
 void uf2_read_block(uint32_t block_no, uint8_t *data);
 int  uf2_write_block(uint32_t block_no, uint8_t *data, WriteState *state);
+// main loop housekeeping: drops raw .BIN copies the host gave up on
+void uf2_task(void);
+
+// next TEST UNIT READY reports UNIT ATTENTION/MEDIUM CHANGED,
+// so the host drops its cached view of the drive
+void msc_disk_media_changed(void);
 
 #endif